@@ -0,0 +1,225 @@
+/**
+ * Serverpp Cache
+ *
+ * Description: Shared caches of open files and static file contents.
+ * Author: Mayank Sindwani
+ * Date: 2015-10-12
+ */
+
+#ifndef __CACHE_SPP_H__
+#define __CACHE_SPP_H__
+
+// SPP Cache constants.
+#define SPP_CACHE_SIZE     (64 * 1024 * 1024)
+#define SPP_CACHE_MAX_FILE (1024 * 1024)
+#define SPP_CACHE_SHARDS   16
+
+// SPP Compression constants.
+#define SPP_GZIP_LEVEL    6
+#define SPP_GZIP_MIN_SIZE 1024
+
+// SPP File cache constants.
+#define SPP_FILE_CACHE_SIZE 512
+#define SPP_FILE_CACHE_TTL  5
+
+#include "process.h"
+#include "util.h"
+#include <unordered_map>
+#include <atomic>
+#include <string>
+
+namespace spp
+{
+    /**
+     * FileHandle: An open file and its metadata, reference counted so that
+     * connections can keep sending a file after it leaves the cache.
+     */
+    class FileHandle
+    {
+    public:
+        // Constructor and destructor.
+        FileHandle(int, const FileInfo&);
+        ~FileHandle(void) { close_file(m_fd); }
+
+    public:
+        // Getters and Setters.
+        const FileInfo& get_info(void) { return m_info; }
+        size_t get_size(void) { return m_info.size; }
+        int get_fd(void) { return m_fd; }
+
+    public:
+        // Member functions.
+        void retain(void) { m_refs++; }
+        void release(void);
+
+    public:
+        // Static functions.
+        static FileHandle* open(const char*);
+
+    private:
+        // Disable copying.
+        FileHandle(const FileHandle&);
+        FileHandle& operator=(const FileHandle&);
+
+    private:
+        // Data members.
+        std::atomic<int> m_refs;
+        FileInfo m_info;
+        int m_fd;
+    };
+
+    /**
+     * FileCache: Open files keyed by resolved path, including paths that
+     * could not be opened, for a fixed time to live (or until invalidated if
+     * it is zero). A hit skips the open, fstat and close of a request. Each
+     * shard holds a bounded number of entries and drops the oldest first.
+     */
+    class FileCache
+    {
+    public:
+        // Constructor and destructor.
+        FileCache(size_t, unsigned long long);
+        ~FileCache(void);
+
+    public:
+        // Getters and Setters.
+        void set_ttl(unsigned long long ttl) { m_ttl = ttl; }
+
+    public:
+        // Member functions.
+        FileHandle* open(const std::string&);
+        void invalidate(const std::string&);
+        void clear(void);
+
+    private:
+        // Internal cache entry, linked from newest to oldest.
+        struct Entry
+        {
+            std::string path;
+            FileHandle* handle;
+            unsigned long long expires;
+            Entry *newer, *older;
+        };
+
+        // Internal cache shard.
+        struct Shard
+        {
+            Shard(void) : newest(NULL), oldest(NULL), generation(0) {}
+
+            std::unordered_map<std::string, Entry*> index;
+            Entry *newest, *oldest;
+            unsigned long long generation;
+            Lock lock;
+        };
+
+        // Helper functions.
+        Shard* get_shard(const std::string&);
+        void unlink(Shard*, Entry*);
+
+    private:
+        // Data members.
+        Shard m_shards[SPP_CACHE_SHARDS];
+        unsigned long long m_ttl;
+        size_t m_entries;
+    };
+
+    /**
+     * CacheBuffer: An immutable, reference counted file body, either as
+     * read or as compressed. Connections hold a reference for as long as
+     * the body is being sent.
+     */
+    class CacheBuffer
+    {
+    public:
+        // Constructor and destructor.
+        CacheBuffer(const FileInfo&, size_t);
+        ~CacheBuffer(void) { delete[] m_data; }
+
+    public:
+        // Getters and Setters.
+        const char* get_data(void) { return m_data; }
+        size_t get_size(void) { return m_size; }
+
+    public:
+        // Member functions.
+        void retain(void) { m_refs++; }
+        void release(void);
+
+    private:
+        // Disable copying.
+        CacheBuffer(const CacheBuffer&);
+        CacheBuffer& operator=(const CacheBuffer&);
+
+    private:
+        friend class ContentCache;
+
+        // Data members.
+        std::atomic<int> m_refs;
+        FileInfo m_info;
+        size_t m_size;
+        char* m_data;
+    };
+
+    /**
+     * ContentCache: File bodies keyed by resolved path and content coding,
+     * held within a byte budget. Paths are hashed over independently locked
+     * shards, and each shard evicts with SIEVE: hits only mark an entry, and
+     * a hand sweeping from the oldest entry evicts the first unmarked one.
+     */
+    class ContentCache
+    {
+    public:
+        // Constructor and destructor.
+        ContentCache(size_t, size_t);
+        ~ContentCache(void);
+
+    public:
+        // Getters and Setters.
+        size_t get_max_file(void) { return m_max_file; }
+
+    public:
+        // Member functions.
+        CacheBuffer* get(const std::string&, FileHandle*, int = 0);
+        CacheBuffer* load(const std::string&, FileHandle*);
+        CacheBuffer* compress(const std::string&, FileHandle*, int);
+        void invalidate(const std::string&);
+        void clear(void);
+
+    private:
+        // Internal cache entry, linked from newest to oldest.
+        struct Entry
+        {
+            std::string path;
+            CacheBuffer* buffer;
+            Entry *newer, *older;
+            bool visited;
+        };
+
+        // Internal cache shard.
+        struct Shard
+        {
+            Shard(void) : newest(NULL), oldest(NULL), hand(NULL), bytes(0) {}
+
+            std::unordered_map<std::string, Entry*> index;
+            Entry *newest, *oldest, *hand;
+            size_t bytes;
+            Lock lock;
+        };
+
+        // Helper functions.
+        Shard* get_shard(const std::string&);
+        CacheBuffer* insert(const std::string&, CacheBuffer*);
+        void evict(Shard*, size_t);
+        void unlink(Shard*, Entry*);
+        void remove(const std::string&);
+
+        static std::string get_key(const std::string&, int);
+
+    private:
+        // Data members.
+        Shard m_shards[SPP_CACHE_SHARDS];
+        size_t m_budget, m_max_file;
+    };
+}
+
+#endif
\ No newline at end of file
@@ -9,139 +9,429 @@
 #ifndef __COLLECTION_SPP_H__
 #define __COLLECTION_SPP_H__
 
+#include <string.h>
 #include <string>
-#include <list>
 
 namespace spp
 {
     /**
-     * Suffix Tree: A string map with O(L) access where L is the length
-     * of the inserted string.
+     * RadixTree: A string map with O(L) access where L is the length of the
+     * key. It is an adaptive radix tree: runs of single-child nodes are
+     * compressed into a path, and each node stores its children in one of
+     * four contiguous layouts sized for 4, 16, 48 or 256 children, growing
+     * as children are added. Keys may also be set as prefixes, which
+     * match any key that starts with them. Missing keys read as T().
      */
     template <class T>
-    class SuffixTree
+    class RadixTree
     {
     public:
         // Constructor
-        SuffixTree(void)
+        RadixTree(void)
         {
-            m_nodes = new Node();
-            m_nodes->value = NULL;
-            m_nodes->index = 0;
-        };
+            m_root = new Node4();
+        }
 
         // Destructor
-        ~SuffixTree(void)
+        ~RadixTree(void)
         {
-            free_nodes(m_nodes);
+            free_nodes(m_root);
         }
 
     private:
-        // Internal tree node.
+        // Disable copying.
+        RadixTree(const RadixTree&);
+        RadixTree& operator=(const RadixTree&);
+
+    private:
+        // Node layouts.
+        enum Type
+        {
+            NODE4,
+            NODE16,
+            NODE48,
+            NODE256
+        };
+
+        // Internal tree node. The path holds the compressed bytes that
+        // follow the byte leading to the node.
         struct Node
         {
-        public:
-            std::list<Node*> chars;
-            char index;
-            T value;
+            Node(Type t) : type(t), count(0), value(), prefix() {}
+
+            unsigned char type;
+            unsigned short count;
+            std::string path;
+            T value, prefix;
+        };
+
+        // Sorted keys with parallel children.
+        struct Node4 : public Node
+        {
+            Node4(void) : Node(NODE4) {}
+
+            unsigned char keys[4];
+            Node* children[4];
+        };
+
+        // Sorted keys with parallel children.
+        struct Node16 : public Node
+        {
+            Node16(void) : Node(NODE16) {}
+
+            unsigned char keys[16];
+            Node* children[16];
+        };
+
+        // A byte index into the children (0 when absent, or slot + 1).
+        struct Node48 : public Node
+        {
+            Node48(void) : Node(NODE48) { memset(index, 0, sizeof(index)); }
+
+            unsigned char index[256];
+            Node* children[48];
+        };
+
+        // Children indexed directly by byte.
+        struct Node256 : public Node
+        {
+            Node256(void) : Node(NODE256) { memset(children, 0, sizeof(children)); }
+
+            Node* children[256];
         };
 
         // Internal node collection.
-        Node* m_nodes;
+        Node* m_root;
 
         void free_nodes(Node* node)
         {
-            typename std::list<Node*>::iterator it;
+            int i;
 
-            if (node->chars.size() == 0)
+            switch (node->type)
             {
-                delete node;
-                return;
+            case NODE4:
+                for (i = 0; i < node->count; i++)
+                    free_nodes(((Node4*)node)->children[i]);
+
+                delete (Node4*)node;
+                break;
+
+            case NODE16:
+                for (i = 0; i < node->count; i++)
+                    free_nodes(((Node16*)node)->children[i]);
+
+                delete (Node16*)node;
+                break;
+
+            case NODE48:
+                for (i = 0; i < node->count; i++)
+                    free_nodes(((Node48*)node)->children[i]);
+
+                delete (Node48*)node;
+                break;
+
+            case NODE256:
+                for (i = 0; i < 256; i++)
+                {
+                    if (((Node256*)node)->children[i] != NULL)
+                        free_nodes(((Node256*)node)->children[i]);
+                }
+
+                delete (Node256*)node;
+                break;
             }
+        }
+
+        // Returns the slot of a child (NULL if absent).
+        static Node** find_child(Node* node, unsigned char c)
+        {
+            Node4* node4;
+            Node16* node16;
+            Node48* node48;
+            Node256* node256;
+            int i;
+
+            switch (node->type)
+            {
+            case NODE4:
+                node4 = (Node4*)node;
+
+                for (i = 0; i < node->count; i++)
+                {
+                    if (node4->keys[i] == c)
+                        return &node4->children[i];
+                }
+
+                return NULL;
+
+            case NODE16:
+                node16 = (Node16*)node;
+
+                for (i = 0; i < node->count && node16->keys[i] <= c; i++)
+                {
+                    if (node16->keys[i] == c)
+                        return &node16->children[i];
+                }
 
-            for (it = node->chars.begin(); it != node->chars.end(); it++)
-                free_nodes(*it);
+                return NULL;
 
-            delete node;
+            case NODE48:
+                node48 = (Node48*)node;
+                return node48->index[c] != 0 ? &node48->children[node48->index[c] - 1] : NULL;
+
+            default:
+                node256 = (Node256*)node;
+                return node256->children[c] != NULL ? &node256->children[c] : NULL;
+            }
         }
 
-    public:
-        // Suffix Tree setter.
-        void set(std::string key, T value)
+        // Moves the shared fields of a node into a larger layout.
+        static void move_node(Node* from, Node* to)
         {
-            typename std::list<Node*>::iterator it;
-            Node *next, *temp, *index;
-            unsigned int i;
-            char c;
+            to->count = from->count;
+            to->path.swap(from->path);
+            to->value = from->value;
+            to->prefix = from->prefix;
+        }
 
-            temp = m_nodes;
+        // Inserts into a sorted key array with room for one more child.
+        static void insert_sorted(unsigned char* keys, Node** children, int count, unsigned char c, Node* child)
+        {
+            int i;
 
-            // Process key character by character.
-            for (i = 0; i < key.length(); i++)
+            for (i = count; i > 0 && keys[i - 1] > c; i--)
             {
-                c = key[i];
-                index = NULL;
+                keys[i] = keys[i - 1];
+                children[i] = children[i - 1];
+            }
+
+            keys[i] = c;
+            children[i] = child;
+        }
 
-                // Search through characters for a matching node.
-                for (it = temp->chars.begin(); it != temp->chars.end(); it++)
+        // Adds a child, replacing the node with a larger layout when full.
+        static void add_child(Node** ref, unsigned char c, Node* child)
+        {
+            Node* node = *ref;
+            Node16* node16;
+            Node48* node48;
+            Node256* node256;
+            int i;
+
+            switch (node->type)
+            {
+            case NODE4:
+                if (node->count < 4)
                 {
-                    next = *it;
-                    if (next->index == c)
-                    {
-                        index = next;
-                        break;
-                    }
+                    insert_sorted(((Node4*)node)->keys, ((Node4*)node)->children, node->count++, c, child);
+                    return;
                 }
 
-                // Create a new node if not found and add it to the list.
-                if (index == NULL)
+                node16 = new Node16();
+                move_node(node, node16);
+                memcpy(node16->keys, ((Node4*)node)->keys, 4);
+                memcpy(node16->children, ((Node4*)node)->children, 4 * sizeof(Node*));
+                delete (Node4*)node;
+                *ref = node16;
+                add_child(ref, c, child);
+                return;
+
+            case NODE16:
+                if (node->count < 16)
                 {
-                    index = new Node();
-                    index->index = c;
-                    index->value = NULL;
-                    temp->chars.push_back(index);
+                    insert_sorted(((Node16*)node)->keys, ((Node16*)node)->children, node->count++, c, child);
+                    return;
                 }
 
-                temp = index;
-            }
+                node48 = new Node48();
+                move_node(node, node48);
+
+                for (i = 0; i < 16; i++)
+                {
+                    node48->index[((Node16*)node)->keys[i]] = (unsigned char)(i + 1);
+                    node48->children[i] = ((Node16*)node)->children[i];
+                }
+
+                delete (Node16*)node;
+                *ref = node48;
+                add_child(ref, c, child);
+                return;
+
+            case NODE48:
+                if (node->count < 48)
+                {
+                    ((Node48*)node)->children[node->count] = child;
+                    ((Node48*)node)->index[c] = (unsigned char)++node->count;
+                    return;
+                }
+
+                node256 = new Node256();
+                move_node(node, node256);
 
-            temp->value = value;
+                for (i = 0; i < 256; i++)
+                {
+                    if (((Node48*)node)->index[i] != 0)
+                        node256->children[i] = ((Node48*)node)->children[((Node48*)node)->index[i] - 1];
+                }
+
+                delete (Node48*)node;
+                *ref = node256;
+                add_child(ref, c, child);
+                return;
+
+            default:
+                ((Node256*)node)->children[c] = child;
+                node->count++;
+                return;
+            }
         }
 
-        // Suffix Tree getter.
-        T get(std::string key)
+        // Returns the node that ends at a key, splitting or adding nodes.
+        Node* insert(const char* key, size_t length)
         {
-            typename std::list<Node*>::iterator it;
-            Node *temp, *index;
-            unsigned int i;
-            char c;
+            Node **ref, **next, *node;
+            Node4 *parent, *leaf;
+            size_t depth, shared;
 
-            temp = m_nodes;
+            ref = &m_root;
+            depth = 0;
 
-            // Search for the provided key.
-            for (i = 0; i < key.length(); i++)
+            for (;;)
             {
-                c = key[i];
-                index = NULL;
+                node = *ref;
+
+                // Match as much of the compressed path as possible.
+                for (shared = 0; shared < node->path.size() && depth + shared < length &&
+                     node->path[shared] == key[depth + shared]; shared++);
 
-                // Get the next node.
-                for (it = temp->chars.begin(); it != temp->chars.end(); it++)
+                // Split the path where the key diverges.
+                if (shared < node->path.size())
                 {
-                    if ((*it)->index == c)
-                    {
-                        index = *it;
-                        break;
-                    }
+                    parent = new Node4();
+                    parent->path.assign(node->path, 0, shared);
+                    parent->keys[0] = (unsigned char)node->path[shared];
+                    parent->children[0] = node;
+                    parent->count = 1;
+
+                    node->path.erase(0, shared + 1);
+                    *ref = node = parent;
+                }
+
+                depth += shared;
+
+                if (depth == length)
+                    return node;
+
+                // Hang the rest of the key off a new leaf.
+                if ((next = find_child(node, (unsigned char)key[depth])) == NULL)
+                {
+                    leaf = new Node4();
+                    leaf->path.assign(key + depth + 1, length - depth - 1);
+                    add_child(ref, (unsigned char)key[depth], leaf);
+                    return leaf;
                 }
 
-                // If the node is not found, return NULL
-                if (index == NULL)
-                    return NULL;
+                ref = next;
+                depth++;
+            }
+        }
+
+    public:
+        // Radix Tree setters.
+        void set(const char* key, size_t length, T value)
+        {
+            insert(key, length)->value = value;
+        }
+
+        void set(const std::string& key, T value)
+        {
+            set(key.data(), key.size(), value);
+        }
+
+        void set_prefix(const char* key, size_t length, T value)
+        {
+            insert(key, length)->prefix = value;
+        }
+
+        void set_prefix(const std::string& key, T value)
+        {
+            set_prefix(key.data(), key.size(), value);
+        }
+
+        // Radix Tree getters.
+        T get(const char* key, size_t length) const
+        {
+            Node** next;
+            Node* node;
+            size_t depth;
+
+            node = m_root;
+            depth = 0;
+
+            for (;;)
+            {
+                // The key must contain the whole compressed path.
+                if (length - depth < node->path.size() ||
+                    memcmp(node->path.data(), key + depth, node->path.size()) != 0)
+                    return T();
+
+                depth += node->path.size();
 
-                temp = index;
+                if (depth == length)
+                    return node->value;
+
+                if ((next = find_child(node, (unsigned char)key[depth])) == NULL)
+                    return T();
+
+                node = *next;
+                depth++;
             }
+        }
 
-            return temp->value;
+        T get(const std::string& key) const
+        {
+            return get(key.data(), key.size());
+        }
+
+        // Returns the value set for the key, or else the value of the longest
+        // prefix that the key starts with, in a single descent.
+        T match(const char* key, size_t length) const
+        {
+            Node** next;
+            Node* node;
+            size_t depth;
+            T best;
+
+            node = m_root;
+            best = T();
+            depth = 0;
+
+            for (;;)
+            {
+                if (length - depth < node->path.size() ||
+                    memcmp(node->path.data(), key + depth, node->path.size()) != 0)
+                    return best;
+
+                depth += node->path.size();
+
+                // Every node on the path is a prefix of the key.
+                if (node->prefix != T())
+                    best = node->prefix;
+
+                if (depth == length)
+                    return node->value != T() ? node->value : best;
+
+                if ((next = find_child(node, (unsigned char)key[depth])) == NULL)
+                    return best;
+
+                node = *next;
+                depth++;
+            }
+        }
+
+        T match(const std::string& key) const
+        {
+            return match(key.data(), key.size());
         }
     };
 }
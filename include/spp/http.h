@@ -9,61 +9,155 @@
 #ifndef __HTTP_SPP_H__
 #define __HTTP_SPP_H__
 
-#include "jconf\parser.h"
+#include "jconf/parser.h"
 #include "collection.h"
+#include "pattern.h"
 #include <string.h>
 #include "util.h"
 #include <string>
 #include <regex>
+#include <vector>
 
 // Location directive keywords.
-#define SPP_HTTP_REGEX "regex"
-#define SPP_HTTP_ERROR "error"
-#define SPP_HTTP_MAP   "map"
+#define SPP_HTTP_REGEX  "regex"
+#define SPP_HTTP_ERROR  "error"
+#define SPP_HTTP_MAP    "map"
+#define SPP_HTTP_PREFIX "prefix"
+
+// Request parser limits and results.
+#define SPP_HTTP_MAX_HEADERS 32
+#define SPP_HTTP_MAX_RANGES  16
+#define SPP_HTTP_PARSE_ERROR -1
+#define SPP_HTTP_PARSE_AGAIN  0
+#define SPP_HTTP_PARSE_DONE   1
+
+// Content codings accepted by a client.
+#define SPP_ENCODING_GZIP 0x01
+#define SPP_ENCODING_BR   0x02
+#define SPP_ENCODING_ALL  (SPP_ENCODING_GZIP | SPP_ENCODING_BR)
 
 // Constant default response content.
+#define SPP_HTTP_400 "<html><body><h2>Server++</h2><div>400 Bad Request</div></body></html>"
 #define SPP_HTTP_500 "<html><body><h2>Server++</h2><div>500 Internal Server Error</div></body></html>"
 #define SPP_HTTP_404 "<html><body><h2>Server++</h2><div>404 Not Found</div></body></html>"
+#define SPP_HTTP_416 "<html><body><h2>Server++</h2><div>416 Range Not Satisfiable</div></body></html>"
+#define SPP_HTTP_503 "<html><body><h2>Server++</h2><div>503 Service Unavailable</div></body></html>"
 
 namespace spp
 {
     enum status
     {
         OK                    = 200,
+        PARTIAL_CONTENT       = 206,
         FOUND                 = 302,
+        NOT_MODIFIED          = 304,
+        BAD_REQUEST           = 400,
         FORBIDDEN             = 403,
         NOT_FOUND             = 404,
-        INTERNAL_SERVER_ERROR = 500
+        RANGE_NOT_SATISFIABLE = 416,
+        INTERNAL_SERVER_ERROR = 500,
+        SERVICE_UNAVAILABLE   = 503
     };
 
+    // Helper functions.
+    const char* get_reason(status);
+
     /**
      * HTTPException
      */
     class HTTPException { };
 
     /**
-     * HTTPRequest: An object representing an HTTP request that
-     * stores relevant parsed data.
+     * HTTPView: A string view into a buffer owned elsewhere.
+     */
+    struct HTTPView
+    {
+        const char* data;
+        size_t size;
+
+        std::string str(void) const { return std::string(data, size); }
+        bool equals(const char*) const;
+        bool contains(const char*) const;
+    };
+
+    /**
+     * HTTPHeader: A header field with views of its name and value.
+     */
+    struct HTTPHeader
+    {
+        HTTPView name;
+        HTTPView value;
+    };
+
+    /**
+     * HTTPRange: A satisfiable byte range of a representation.
+     */
+    struct HTTPRange
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    /**
+     * HTTPRequest: A resumable request parser. Bytes are consumed as they
+     * arrive and every field is a view into the receive buffer, which must
+     * not move until the request is reset.
      */
     class HTTPRequest
     {
     public:
         // Constructor.
-        HTTPRequest(char*, size_t);
+        HTTPRequest(void) { reset(); }
 
     public:
         // Getters and setters.
-        std::map<std::string, std::string> get_params(void) { return m_params; }
-        std::string get_method() { return m_method; }
-        std::string get_protocol() { return m_protocol; }
-        std::string get_uri() { return m_uri; }
+        std::map<std::string, std::string> get_params(void);
+        const HTTPView* get_header(const char*);
+        int get_encodings(void);
+        HTTPView get_method() { return m_method; }
+        HTTPView get_protocol() { return m_protocol; }
+        HTTPView get_query() { return m_query; }
+        HTTPView get_uri() { return m_uri; }
+        size_t get_size() { return m_size; }
+        bool is_keep_alive(void);
+        bool is_not_modified(const char*, long long);
+        bool is_range_current(const char*, long long);
+        int get_ranges(size_t, HTTPRange*, int);
+
+    public:
+        // Member functions.
+        int parse(const char*, size_t);
+        void reset(void);
 
     private:
+        // Parser states.
+        enum State
+        {
+            METHOD,
+            URI,
+            PROTOCOL,
+            REQUEST_LINE_LF,
+            HEADER_START,
+            HEADER_NAME,
+            HEADER_VALUE_WS,
+            HEADER_VALUE,
+            HEADER_LF,
+            HEADERS_LF,
+            BODY,
+            DONE
+        };
+
         // Data members.
-        std::map<std::string, std::string> m_params;
-        std::string m_protocol,
-                    m_method,
-                    m_uri;
+        HTTPHeader m_headers[SPP_HTTP_MAX_HEADERS];
+        HTTPView m_method,
+                 m_protocol,
+                 m_query,
+                 m_uri;
+        size_t m_offset,
+               m_start,
+               m_size;
+        State m_state;
+        int m_count;
     };
 
     /**
@@ -92,8 +186,8 @@ namespace spp
     };
 
     /**
-     * HTTPUriMap: A collection of HTTPLocations mapped to uri constants
-     * and or regular expressions.
+     * HTTPUriMap: A collection of HTTPLocations mapped to uri constants,
+     * uri prefixes and or regular expressions.
      */
     class HTTPUriMap
     {
@@ -107,11 +201,15 @@ namespace spp
         HTTPLocation* get_location(HTTPRequest*);
         char* get_error(const char*, size_t*);
 
+    public:
+        // Member functions.
+        void compile(void);
+
     private:
         // Data members.
-        std::list< std::pair<std::regex, HTTPLocation*> > m_expressions;
-        std::list< std::pair<std::regex, HTTPLocation*> > m_errors;
-        SuffixTree<HTTPLocation*> m_locations;
+        std::vector<HTTPLocation*> m_expressions, m_errors;
+        PatternSet m_expression_patterns, m_error_patterns;
+        RadixTree<HTTPLocation*> m_locations;
     };
 }
 
@@ -0,0 +1,78 @@
+/**
+ * Serverpp Pattern
+ *
+ * Description: Matches a uri against many regular expressions at once.
+ * Author: Mayank Sindwani
+ * Date: 2015-10-17
+ */
+
+#ifndef __PATTERN_SPP_H__
+#define __PATTERN_SPP_H__
+
+// SPP Pattern constants.
+#define SPP_PATTERN_MAX_REPEAT 256
+#define SPP_PATTERN_MAX_NFA    16384
+#define SPP_PATTERN_MAX_DFA    4096
+
+#include <bitset>
+#include <vector>
+#include <regex>
+
+namespace spp
+{
+    struct PatternNode;
+
+    /**
+     * PatternSet: An ordered list of regular expressions compiled into one
+     * DFA over byte classes. A match reads the input once and reports the
+     * first expression that matches all of it, like calling regex_match on
+     * each in turn. Expressions the compiler does not support (assertions,
+     * backreferences, lookaheads) keep a std::regex that is only tried
+     * when it precedes the DFA's match. If the DFA grows too large, the
+     * automaton is simulated instead.
+     */
+    class PatternSet
+    {
+    public:
+        // Constructor.
+        PatternSet(void);
+
+    public:
+        // Getters and Setters.
+        size_t size(void) { return m_count; }
+
+    public:
+        // Member functions.
+        void add(const char*);
+        void compile(void);
+        int match(const char*, size_t) const;
+
+    private:
+        // Internal automaton state.
+        struct State
+        {
+            int type;
+            int out, out1;
+            int arg;
+        };
+
+        // Helper functions.
+        int add_state(int, int, int, int);
+        int build(const PatternNode&, int);
+        void closure(std::vector<int>&, std::vector<char>&) const;
+        int get_accept(const std::vector<int>&) const;
+        int simulate(const char*, size_t) const;
+
+    private:
+        // Data members.
+        std::vector< std::pair<int, std::regex> > m_fallback;
+        std::vector< std::bitset<256> > m_sets;
+        std::vector<State> m_states;
+        std::vector<int> m_starts, m_table, m_accept;
+        unsigned char m_classes[256];
+        int m_nclasses, m_start, m_count;
+        bool m_dfa;
+    };
+}
+
+#endif
\ No newline at end of file
@@ -11,10 +11,19 @@
 
 #if defined(SPP_WINDOWS)
     #include <Windows.h>
+    #include <process.h>
 #elif defined(SPP_LINUX)
+    #include <condition_variable>
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <time.h>
     #include <mutex>
 #endif
 
+#include <stddef.h>
+#include <vector>
+#include <deque>
+
 namespace spp
 {
     /**
@@ -39,7 +48,92 @@ namespace spp
 #elif defined(SPP_LINUX)
         std::recursive_mutex m_mtx;
 #endif
+
+        friend class Condition;
 	};
+
+    /**
+     * Condition: Condition variable wrapper used with a Lock.
+     */
+    class Condition
+    {
+    public:
+        // Constructor
+        Condition(void);
+
+    public:
+        // Wait and signal
+        void wait(Lock*);
+        void signal(void);
+        void broadcast(void);
+
+    private:
+        // Data members.
+#if defined(SPP_WINDOWS)
+        CONDITION_VARIABLE m_cv;
+#elif defined(SPP_LINUX)
+        std::condition_variable_any m_cv;
+#endif
+    };
+
+    /**
+     * Task: A unit of work run by a ThreadPool.
+     */
+    class Task
+    {
+    public:
+        // Destructor
+        virtual ~Task(void) {}
+
+    public:
+        // Runs the task and releases it.
+        virtual void run(void) = 0;
+    };
+
+    /**
+     * ThreadPool: A fixed set of threads consuming a bounded task queue.
+     */
+    class ThreadPool
+    {
+    public:
+        // Constructor / Destructor
+        ThreadPool(unsigned int, size_t);
+        ~ThreadPool(void);
+
+    public:
+        // Member functions.
+        bool submit(Task*);
+        void start(void);
+        void stop(void);
+
+    private:
+        // Thread entry point.
+        void run(void);
+
+#if defined(SPP_WINDOWS)
+        static unsigned int __stdcall thread_main(void*);
+#elif defined(SPP_LINUX)
+        static void* thread_main(void*);
+#endif
+
+    private:
+        // Data members.
+#if defined(SPP_WINDOWS)
+        std::vector<HANDLE> m_threads;
+#elif defined(SPP_LINUX)
+        std::vector<pthread_t> m_threads;
+#endif
+        std::deque<Task*> m_tasks;
+        unsigned int m_size;
+        size_t m_capacity;
+        Condition m_cv;
+        Lock m_mtx;
+        bool m_stop;
+    };
+
+    // Helper functions.
+    unsigned long long get_ticks(void);
+    unsigned int get_cpu_count(void);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,328 @@
+/**
+ * Serverpp Reactor
+ *
+ * Description: Defines socket readiness demultiplexers for the server loop.
+ * Author: Mayank Sindwani
+ * Date: 2015-10-03
+ */
+
+#ifndef __REACTOR_SPP_H__
+#define __REACTOR_SPP_H__
+
+// SPP Reactor constants.
+#define SPP_EVENT_READ   0x01
+#define SPP_EVENT_WRITE  0x02
+#define SPP_EVENT_ERROR  0x04
+#define SPP_MAX_EVENTS   256
+#define SPP_REACTOR_TICK 1000
+#define SPP_URING_ENTRIES 1024
+#define SPP_URING_RETRY   10
+#define SPP_URING_BUFFERS 1024
+#define SPP_URING_BUFFER_SIZE 1024
+
+// Completion events.
+#define SPP_EVENT_ACCEPT 0x08
+#define SPP_EVENT_RECV   0x10
+#define SPP_EVENT_SEND   0x20
+#define SPP_EVENT_SPLICE 0x40
+#define SPP_EVENT_RESULT (SPP_EVENT_ACCEPT | SPP_EVENT_RECV | SPP_EVENT_SEND | SPP_EVENT_SPLICE)
+
+// Timer wheel geometry.
+#define SPP_TIMER_RESOLUTION 100
+#define SPP_TIMER_LEVELS     4
+#define SPP_TIMER_BITS       6
+#define SPP_TIMER_SLOTS      (1 << SPP_TIMER_BITS)
+
+// I/O backend names.
+#define SPP_IO_SELECT "select"
+#define SPP_IO_EPOLL  "epoll"
+#define SPP_IO_URING  "io_uring"
+
+#include <errno.h>
+
+#if defined(SPP_WINDOWS)
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <process.h>
+
+#define SPP_SEND_FLAGS 0
+#define SPP_MORE_FLAGS 0
+
+#elif defined(SPP_LINUX)
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+// Winsock compatibility.
+typedef int SOCKET;
+typedef pthread_t HANDLE;
+typedef unsigned int DWORD;
+
+#define INVALID_SOCKET  (-1)
+#define SOCKET_ERROR    (-1)
+#define WSAEWOULDBLOCK  EWOULDBLOCK
+#define WSAECONNRESET   ECONNRESET
+#define SPP_SEND_FLAGS  MSG_NOSIGNAL
+#define SPP_MORE_FLAGS  MSG_MORE
+#define __stdcall
+
+static inline int closesocket(SOCKET s) { return ::close(s); }
+static inline int ioctlsocket(SOCKET s, long cmd, u_long* arg) { return ::ioctl(s, cmd, arg); }
+static inline int WSAGetLastError(void) { return errno; }
+static inline void WSASetLastError(int err) { errno = err; }
+
+#endif
+
+#include <vector>
+#include <map>
+
+namespace spp
+{
+    /**
+     * ReactorEvent: A readiness notification for a registered socket, or
+     * the result of a completed operation.
+     */
+    struct ReactorEvent
+    {
+        void* data;
+        int events;
+        int result;
+        const char* buffer;
+    };
+
+    /**
+     * Reactor: An interface for waiting on socket readiness. Sockets are
+     * registered once and their interest is updated in place.
+     */
+    class Reactor
+    {
+    public:
+        // Destructor.
+        virtual ~Reactor(void) {}
+
+    public:
+        // Member functions.
+        virtual bool add(SOCKET, int, void*) = 0;
+        virtual bool modify(SOCKET, int, void*) = 0;
+        virtual void remove(SOCKET) = 0;
+        virtual int wait(ReactorEvent*, int, int) = 0;
+    };
+
+#if defined(SPP_LINUX)
+
+    /**
+     * EpollReactor: A reactor backed by a persistent epoll set. The cost
+     * of a wakeup is proportional to the number of ready sockets.
+     */
+    class EpollReactor : public Reactor
+    {
+    public:
+        // Constructor and destructor.
+        EpollReactor(void);
+        ~EpollReactor(void);
+
+    public:
+        // Getters and Setters.
+        bool is_open(void) { return m_epoll >= 0; }
+
+    public:
+        // Member functions.
+        bool add(SOCKET, int, void*);
+        bool modify(SOCKET, int, void*);
+        void remove(SOCKET);
+        int wait(ReactorEvent*, int, int);
+
+    private:
+        // Data members.
+        int m_epoll;
+    };
+
+    /**
+     * UringReactor: A reactor backed by io_uring. Registered sockets get
+     * readiness from one-shot poll requests, and sockets can also be served
+     * by completion: a multishot accept, receives into a ring of provided
+     * buffers, and sends and splices whose results are returned as events.
+     * Everything queued between waits is submitted in one batch.
+     */
+    class UringReactor : public Reactor
+    {
+    public:
+        // Constructor and destructor.
+        UringReactor(unsigned int entries = SPP_URING_ENTRIES);
+        ~UringReactor(void);
+
+    public:
+        // Getters and Setters.
+        bool is_open(void) { return m_ring >= 0; }
+
+    public:
+        // Member functions.
+        bool add(SOCKET, int, void*);
+        bool modify(SOCKET, int, void*);
+        void remove(SOCKET);
+        int wait(ReactorEvent*, int, int);
+
+    public:
+        // Completion-based operations.
+        bool accept(SOCKET);
+        bool recv(SOCKET, size_t, void*);
+        bool send(SOCKET, struct msghdr*, int, void*);
+        bool splice(int, off_t, size_t, int*, SOCKET, size_t, void*);
+
+    private:
+        // Internal socket registration.
+        struct Registration
+        {
+            void* data;
+            int events;
+            unsigned int gen;
+            bool armed, delay;
+        };
+
+        // Helper functions.
+        struct io_uring_sqe* get_sqe(void);
+        bool reserve(unsigned int);
+        void disarm(SOCKET, Registration*);
+        void arm(SOCKET, Registration*);
+        void arm_accept(void);
+        void provide(unsigned short);
+        unsigned int next_gen(void);
+        int submit(unsigned int, unsigned int);
+
+    private:
+        // Ring mappings.
+        void *m_sq_ptr, *m_cq_ptr;
+        size_t m_sq_size, m_cq_size, m_sqes_size;
+        struct io_uring_sqe* m_sqes;
+        struct io_uring_cqe* m_cqes;
+        unsigned int *m_sq_head, *m_sq_tail, *m_sq_mask, *m_sq_array,
+                     *m_cq_head, *m_cq_tail, *m_cq_mask;
+
+        // Provided receive buffers. Buffers returned with events go back to
+        // the ring on the next wait.
+        struct io_uring_buf_ring* m_buf_ring;
+        std::vector<unsigned short> m_used;
+        unsigned short m_buf_tail;
+        char* m_buffers;
+
+        // Data members.
+        std::map<SOCKET, Registration> m_sockets;
+        std::vector<SOCKET> m_arm;
+        struct __kernel_timespec m_ts, m_retry;
+        unsigned int m_pending, m_entries, m_gen;
+        bool m_timeout, m_accepting, m_accept_delay;
+        SOCKET m_listener;
+        int m_ring;
+    };
+
+#endif
+
+    /**
+     * SelectReactor: A portable reactor that rebuilds fd_sets from its
+     * registrations on every wait.
+     */
+    class SelectReactor : public Reactor
+    {
+    public:
+        // Constructor.
+        SelectReactor(void) {}
+
+    public:
+        // Member functions.
+        bool add(SOCKET, int, void*);
+        bool modify(SOCKET, int, void*);
+        void remove(SOCKET);
+        int wait(ReactorEvent*, int, int);
+
+    private:
+        // Data members.
+        std::map< SOCKET, std::pair<int, void*> > m_sockets;
+    };
+
+    /**
+     * Notifier: A pollable handle used to wake a reactor from another
+     * thread.
+     */
+    class Notifier
+    {
+    public:
+        // Constructor and destructor.
+        Notifier(void);
+        ~Notifier(void);
+
+    public:
+        // Getters and Setters.
+        SOCKET get_socket(void) { return m_socket; }
+        bool is_open(void) { return m_socket != INVALID_SOCKET; }
+
+    public:
+        // Member functions.
+        void signal(void);
+        void clear(void);
+
+    private:
+        // Data members.
+        SOCKET m_socket;
+    };
+
+    /**
+     * Timer: An intrusive timer node embedded in the object it times.
+     */
+    struct Timer
+    {
+        Timer(void) : next(NULL), prev(NULL), expires(0), data(NULL) {}
+
+        Timer *next, *prev;
+        unsigned long long expires;
+        void* data;
+    };
+
+    /**
+     * TimerWheel: A hierarchical timing wheel. Scheduling and cancelling
+     * are O(1), and each tick only touches the timers that are due or
+     * that move down a level.
+     */
+    class TimerWheel
+    {
+    public:
+        // Constructor.
+        TimerWheel(unsigned long long);
+
+    public:
+        // Getters and Setters.
+        bool is_scheduled(Timer* timer) { return timer->prev != NULL; }
+        bool empty(void) { return m_count == 0; }
+
+    public:
+        // Member functions.
+        void schedule(Timer*, unsigned long long);
+        void cancel(Timer*);
+        void advance(unsigned long long, std::vector<Timer*>&);
+
+    private:
+        // Helper functions.
+        void insert(Timer*);
+
+    private:
+        // Data members.
+        Timer m_slots[SPP_TIMER_LEVELS][SPP_TIMER_SLOTS];
+        unsigned long long m_tick;
+        size_t m_count;
+    };
+
+    // Helper functions.
+    Reactor* create_reactor(const char*);
+    const char* default_reactor(void);
+}
+
+#endif
\ No newline at end of file
@@ -9,12 +9,121 @@
 #ifndef SSL_SPP_H
 #define SSL_SPP_H
 
+// SSL session constants.
+#define SPP_SSL_CACHE_SIZE      20480
+#define SPP_SSL_CACHE_STRIPES   16
+#define SPP_SSL_SESSION_TIMEOUT 300
+#define SPP_SSL_TICKET_ROTATION 3600
+
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include "process.h"
+#include <string>
+#include <list>
+#include <map>
+
+// Kernel TLS lets the socket encrypt file bodies sent with sendfile.
+#if defined(SPP_LINUX) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    #define SPP_KTLS
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    #include <openssl/core_names.h>
+    typedef EVP_MAC_CTX SPP_TICKET_MAC;
+#else
+    typedef HMAC_CTX SPP_TICKET_MAC;
+#endif
 
 namespace spp
 {
+    /**
+     * SSLSessionCache: A bounded server-side session cache shared by every
+     * worker of a server. Sessions are spread over independently locked
+     * stripes, each evicting its least recently used entry when full.
+     */
+    class SSLSessionCache
+    {
+    public:
+        // Constructor and destructor.
+        SSLSessionCache(size_t, long);
+        ~SSLSessionCache(void);
+
+    public:
+        // Member functions.
+        void attach(SSL_CTX*);
+        bool add(SSL_SESSION*);
+        SSL_SESSION* get(const unsigned char*, int);
+        void remove(SSL_SESSION*);
+
+    private:
+        // OpenSSL callbacks.
+        static int new_session(SSL*, SSL_SESSION*);
+        static SSL_SESSION* get_session(SSL*, const unsigned char*, int, int*);
+        static void remove_session(SSL_CTX*, SSL_SESSION*);
+
+    private:
+        // Internal cache stripe.
+        typedef std::list< std::pair<std::string, SSL_SESSION*> > Entries;
+
+        struct Stripe
+        {
+            std::map<std::string, Entries::iterator> index;
+            Entries entries;
+            Lock lock;
+        };
+
+        // Helper functions.
+        Stripe* get_stripe(const std::string&);
+
+    private:
+        // Data members.
+        Stripe m_stripes[SPP_SSL_CACHE_STRIPES];
+        size_t m_capacity;
+        long m_timeout;
+    };
+
+    /**
+     * SSLTicketKeys: Session ticket keys that rotate on an interval. Tickets
+     * sealed with the previous key are still accepted and then reissued.
+     */
+    class SSLTicketKeys
+    {
+    public:
+        // Constructor.
+        SSLTicketKeys(unsigned int);
+
+    public:
+        // Member functions.
+        void attach(SSL_CTX*);
+        int seal(unsigned char*, unsigned char*, EVP_CIPHER_CTX*, SPP_TICKET_MAC*, int);
+
+    private:
+        // OpenSSL callbacks.
+        static int ticket_key(SSL*, unsigned char*, unsigned char*, EVP_CIPHER_CTX*, SPP_TICKET_MAC*, int);
+
+    private:
+        // Internal ticket key.
+        struct Key
+        {
+            unsigned char name[16];
+            unsigned char aes[32];
+            unsigned char hmac[32];
+        };
+
+        // Helper functions.
+        void rotate(void);
+
+    private:
+        // Data members.
+        Key m_current, m_previous;
+        unsigned long long m_rotated;
+        unsigned int m_rotation;
+        Lock m_lock;
+    };
+
     // Helper functions.
     void init_ssl(void);
     int  load_certificates(SSL_CTX*, const char*, const char*);
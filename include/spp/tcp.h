@@ -11,32 +11,84 @@
 
 // SPP Socket constants.
 #define SPP_MAX_HEADER_SIZE 1024
+#define SPP_MAX_SEGMENTS    8
+#define SPP_POOL_THREADS    8
+#define SPP_POOL_QUEUE      4096
+#define SPP_KEEPALIVE_REQUESTS 100
+#define SPP_KEEPALIVE_TIMEOUT  75
+#define SPP_HEADER_TIMEOUT  10
+#define SPP_WRITE_TIMEOUT   60
+#define SPP_KTLS_CHUNK      (1 << 30)
+#define SPP_CHUNK_SIZE      16384
+#define SPP_PIPE_SIZE       (1 << 18)
+#define SPP_SLAB_CHUNK      256
+#define SPP_SLAB_INDEX_BITS 20
 
-#if defined(SPP_WINDOWS)
-
-#include <WinSock2.h>
-#include <WS2tcpip.h>
-#include <process.h>
-
-#elif defined(SPP_LINUX)
-
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <sys/time.h>
-
-typedef SOCKET int
-
-#endif
-
+#include <stdint.h>
 #include <errno.h>
 #include <sstream>
+#include <atomic>
+#include <set>
+#include "reactor.h"
+#include "cache.h"
+#include "watch.h"
 #include "http.h"
 #include "log.h"
 #include "ssl.h"
 
 namespace spp
 {
+    /**
+     * TCPBuffer: An ordered queue of memory segments written with a single
+     * gather call. Partial writes advance through the segments exactly.
+     */
+    class TCPBuffer
+    {
+    public:
+        // Constructors.
+        TCPBuffer(void)
+            : m_count(0),
+            m_index(0) {}
+
+    public:
+        // Getters and Setters.
+        bool empty(void) { return m_index == m_count; }
+
+    public:
+        // Member functions.
+        bool push(const char*, size_t);
+        void consume(size_t);
+        void clear(void);
+        int write(SOCKET, int);
+        int write(SSL*);
+#if defined(SPP_LINUX)
+        int gather(struct iovec*);
+#endif
+
+    private:
+        // Internal segment.
+        struct Segment
+        {
+            const char* data;
+            size_t size;
+        };
+
+        // Data members.
+        Segment m_segments[SPP_MAX_SEGMENTS];
+        int m_count, m_index;
+    };
+
+    /**
+     * TCPPart: A part of a multipart body. Its header is followed by a range
+     * of the file or of the cached body.
+     */
+    struct TCPPart
+    {
+        size_t header, header_size;
+        off_t offset;
+        size_t size;
+    };
+
     /**
      * TCPClient: A represenation of a client connection with its
      * TCP socket descripter and content buffer.
@@ -45,29 +97,216 @@ namespace spp
     {
     public:
         // Constructors.
-        TCPClient(SOCKET s, SSL* ssl = NULL)
-            : socket(s),
+        TCPClient(SOCKET s, sockaddr_in a, SSL* ssl = NULL)
+            : content(NULL),
+            socket(s),
+            addr(a),
             header_size(0),
-            content_size(0),
-            content(NULL),
-            ssl(ssl){}
+            request_size(0),
+            file(-1),
+            file_offset(0),
+            file_remaining(0),
+            chunk(NULL),
+            chunk_size(0),
+            chunk_offset(0),
+            source(NULL),
+            cached(NULL),
+            part(0),
+            requests(0),
+            keep_alive(false),
+            events(0),
+            read_want(SPP_EVENT_READ),
+            write_want(SPP_EVENT_WRITE),
+            eof(false),
+            pending(false),
+            handshaking(ssl != NULL),
+            ktls(false),
+            handle(NULL),
+            ssl(ssl)
+        {
+#if defined(SPP_LINUX)
+            ring = NULL;
+            ops = 0;
+            receiving = sending = splicing = closing = false;
+            pipes[0] = pipes[1] = -1;
+            pipe_size = piped = 0;
+            spliced = 0;
+#endif
+        }
+
+    public:
+        // Getters and Setters.
+        bool is_sending(void) { return !output.empty() || file_remaining > 0 || part < parts.size(); }
+        bool is_reading(void) { return !eof && header_size < SPP_MAX_HEADER_SIZE; }
+        int get_events(void);
 
     public:
         // Socket functions.
+        void prepare(size_t, const char*, size_t);
+        int handshake(void);
+        void reset(void);
         void close(void);
+        void next_part(void);
+        void truncate(void);
+        int send_chunk(void);
         int send(void);
         int recv(void);
 
+#if defined(SPP_LINUX)
+        // Completion functions.
+        bool queue_recv(void);
+        bool queue_send(void);
+        int complete_recv(int, const char*);
+        int complete_send(int);
+#endif
+
+    private:
+        // Helper functions.
+        int ssl_error(int, int&);
+
     public:
         // Public data members.
         char headers[SPP_MAX_HEADER_SIZE],
+             response[SPP_MAX_HEADER_SIZE],
             *content;
 
         SOCKET socket;
+        sockaddr_in addr;
         size_t header_size,
-               content_size;
+               request_size;
+        HTTPRequest request;
+        TCPBuffer output;
+
+        // File body streamed by the kernel or copied through the chunk.
+        int file;
+        off_t file_offset;
+        size_t file_remaining;
+        char* chunk;
+        size_t chunk_size,
+               chunk_offset;
 
+        // Shared open file and body served from memory.
+        FileHandle* source;
+        CacheBuffer* cached;
+
+        // Remaining parts of a multipart body.
+        std::vector<TCPPart> parts;
+        std::string part_headers;
+        size_t part;
+
+        // Connection persistence.
+        unsigned int requests;
+        bool keep_alive;
+        Timer timer;
+
+        // Registered reactor interest, the readiness that resumes a read or
+        // write (TLS may need either for both), and whether the client
+        // half-closed.
+        int events,
+            read_want,
+            write_want;
+        bool eof;
+
+        bool pending;
+        bool handshaking;
+        bool ktls;
+        void* handle;
         SSL* ssl;
+
+#if defined(SPP_LINUX)
+        // Completion-driven I/O on the io_uring backend: the operations in
+        // flight, the message of a gathered send, and the pipe that splices
+        // file bodies with the bytes it holds and the result of filling it.
+        UringReactor* ring;
+        unsigned int ops;
+        bool receiving,
+             sending,
+             splicing,
+             closing;
+        struct msghdr message;
+        struct iovec vectors[SPP_MAX_SEGMENTS];
+        int pipes[2];
+        size_t pipe_size,
+               piped;
+        int spliced;
+#endif
+    };
+
+    /**
+     * TCPSlab: Chunked storage for a worker's clients. Slots are reused
+     * through a free list and named by handles that carry a generation, so
+     * events for a closed connection never reach the slot's next owner.
+     */
+    class TCPSlab
+    {
+    public:
+        // Constructor and destructor.
+        TCPSlab(void);
+        ~TCPSlab(void);
+
+    public:
+        // Getters and Setters.
+        TCPClient* get(void*);
+        TCPClient* at(size_t);
+        size_t capacity(void) { return m_generations.size(); }
+        size_t size(void) { return m_size; }
+
+    public:
+        // Member functions.
+        TCPClient* alloc(SOCKET, sockaddr_in, SSL*);
+        void free(TCPClient*);
+
+    private:
+        // Helper functions.
+        bool grow(void);
+
+    private:
+        // Data members.
+        std::vector<TCPClient*> m_chunks;
+        std::vector<uintptr_t> m_generations;
+        std::vector<size_t> m_free;
+        size_t m_size;
+    };
+
+    class TCPServer;
+
+    /**
+     * TCPWorker: A server thread with its own listening socket, reactor
+     * and connection set.
+     */
+    class TCPWorker
+    {
+    public:
+        // Constructors.
+        TCPWorker(TCPServer* s)
+            : server(s),
+            reactor(NULL),
+#if defined(SPP_LINUX)
+            ring(NULL),
+#endif
+            timers(get_ticks()),
+            pending(0),
+            slisten(INVALID_SOCKET) {}
+
+    public:
+        // Completion queue.
+        void complete(TCPClient*);
+
+    public:
+        // Public data members.
+        TCPSlab clients;
+        std::vector<TCPClient*> completed;
+        TCPServer* server;
+        Reactor* reactor;
+#if defined(SPP_LINUX)
+        UringReactor* ring;
+#endif
+        TimerWheel timers;
+        Notifier notifier;
+        Lock mtx_completed;
+        unsigned int pending;
+        SOCKET slisten;
+        HANDLE thread;
     };
 
     /**
@@ -88,10 +327,24 @@ namespace spp
     public:
         // Member functions.
         virtual status generate_response(TCPClient*, HTTPRequest*);
+        virtual status generate_error(TCPClient*, status, const char*);
+        virtual status generate_default(TCPClient*, status, const char*);
+        virtual void serve(TCPClient*);
+        virtual void handle_completed(TCPWorker*);
+        virtual void handle_handshake(TCPWorker*, TCPClient*);
+        virtual void handle_timeouts(TCPWorker*);
+        virtual void handle_read(TCPWorker*, TCPClient*);
+        virtual void handle_write(TCPWorker*, TCPClient*);
+        virtual void close_client(TCPWorker*, TCPClient*);
+        virtual void accept_client(TCPWorker*);
+        virtual void add_client(TCPWorker*, SOCKET, sockaddr_in);
+#if defined(SPP_LINUX)
+        virtual void handle_result(TCPWorker*, ReactorEvent*);
+#endif
+        virtual int run(TCPWorker*);
         virtual void start(void);
         virtual void wait(void);
         virtual void stop(void);
-        virtual int run(void);
 
     public:
         // General TCPListener Exception
@@ -110,18 +363,48 @@ namespace spp
         };
 
     protected:
-        HANDLE m_listener;
-        SOCKET m_slisten;
-        bool m_stop;
+        // Helper functions.
+        void set_response(TCPClient*, status, const char*, const char*, size_t, const char* = "");
+        status set_ranges(TCPClient*, const char*, size_t, HTTPRange*, int, const char*);
+        FileHandle* get_file(const std::string&);
+        FileHandle* get_variant(const std::string&, FileHandle*, const char*);
+        void finish_response(TCPWorker*, TCPClient*);
+        void finish_read(TCPWorker*, TCPClient*, int);
+        void finish_write(TCPWorker*, TCPClient*, int);
+        void set_timeout(TCPWorker*, TCPClient*, unsigned int);
+        void update_events(TCPWorker*, TCPClient*);
+        void dispatch(TCPWorker*, TCPClient*);
+        SOCKET create_listener(void);
+        void free_workers(void);
+
+    protected:
+        std::vector<TCPWorker*> m_workers;
+        ContentCache* m_cache;
+        FileCache* m_files;
+#if defined(SPP_LINUX)
+        FileWatcher* m_watcher;
+#endif
+        unsigned int m_nworkers,
+                     m_keepalive_requests,
+                     m_keepalive_timeout,
+                     m_header_timeout,
+                     m_write_timeout;
+        ThreadPool* m_pool;
+        std::atomic<bool> m_stop;
         int m_port;
 
     private:
         // Data members.
         std::list<HTTPLocation*> m_locations;
-        std::string m_log, m_cert, m_ckey;
+        std::string m_log, m_cert, m_ckey, m_io;
         HTTPUriMap m_uri_map;
+        std::set<std::string> m_gzip_types;
+        size_t m_gzip_min_size;
+        int m_gzip_level;
+        SSLSessionCache* m_ssl_cache;
+        SSLTicketKeys* m_ssl_tickets;
+        bool m_ktls;
         SSL_CTX* m_ssl_ctx;
-        Lock m_mtx_stop;
     };
 
     /**
@@ -158,7 +441,7 @@ namespace spp
         void stop_servers(void);
 
         void add_type(std::string, std::string);
-        std::string get_type(std::string);
+        std::string get_type(std::string) const;
 
     private:
         // Data members.
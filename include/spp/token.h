@@ -0,0 +1,30 @@
+/**
+ * Serverpp Token
+ *
+ * Description: Vectorized delimiter scanning for the request parser.
+ * Author: Mayank Sindwani
+ * Date: 2015-10-10
+ */
+
+#ifndef __TOKEN_SPP_H__
+#define __TOKEN_SPP_H__
+
+#include <stddef.h>
+
+// Delimiter classes.
+#define SPP_TOKEN_SP      0x01 // ' '
+#define SPP_TOKEN_CRLF    0x02 // '\r' and '\n'
+#define SPP_TOKEN_COLON   0x04 // ':'
+#define SPP_TOKEN_QUERY   0x08 // '?'
+#define SPP_TOKEN_AMP     0x10 // '&'
+#define SPP_TOKEN_EQUALS  0x20 // '='
+#define SPP_TOKEN_PERCENT 0x40 // '%'
+
+namespace spp
+{
+    // Helper functions.
+    size_t find_token(const char*, size_t, int);
+    const char* get_tokenizer(void);
+}
+
+#endif
\ No newline at end of file
@@ -17,11 +17,26 @@
 
 namespace spp
 {
+    /**
+     * FileInfo: The metadata of an opened regular file.
+     */
+    struct FileInfo
+    {
+        size_t size;
+        long long mtime;
+        unsigned long long inode;
+    };
+
     // Helper functions.
     void render_template(std::string&, std::map<std::string, std::string>*);
     char* read_file(const char*, size_t*);
+    int open_file(const char*, FileInfo*);
+    long read_file_at(int, char*, size_t, long long);
+    void close_file(int);
     char* get_ext(const char*, size_t);
-    int trim(char**, size_t, int*);
+    void normalize_path(std::string&);
+    void format_http_date(long long, char*, size_t);
+    bool parse_http_date(const char*, size_t, long long*);
 }
 
 #endif
\ No newline at end of file
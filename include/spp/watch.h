@@ -0,0 +1,80 @@
+/**
+ * Serverpp Watch
+ *
+ * Description: Invalidates cached static files when they change on disk.
+ * Author: Mayank Sindwani
+ * Date: 2015-10-13
+ */
+
+#ifndef __WATCH_SPP_H__
+#define __WATCH_SPP_H__
+
+// SPP Watch constants.
+#define SPP_WATCH_DELAY     50
+#define SPP_WATCH_MAX_DELAY 1000
+#define SPP_WATCH_MAX_PATHS 4096
+#define SPP_WATCH_BUFFER    65536
+
+#include "reactor.h"
+#include "cache.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+
+namespace spp
+{
+#if defined(SPP_LINUX)
+
+    /**
+     * FileWatcher: Watches a directory tree with inotify and drops the cache
+     * entries of the files that change in it. Events are collected until the
+     * tree has been quiet for a short delay, so a deploy that touches many
+     * files invalidates each path once. If too many paths change, a
+     * directory moves, or the kernel queue overflows, the caches are
+     * cleared instead.
+     */
+    class FileWatcher
+    {
+    public:
+        // Constructor and destructor.
+        FileWatcher(FileCache*, ContentCache*);
+        ~FileWatcher(void);
+
+    public:
+        // Getters and Setters.
+        bool is_open(void) { return m_inotify >= 0 && m_notifier.is_open(); }
+
+    public:
+        // Member functions.
+        bool watch(const std::string&);
+        void start(void);
+        void stop(void);
+
+    private:
+        // Helper functions.
+        bool add_tree(const std::string&);
+        void read_events(void);
+        void flush(void);
+        void run(void);
+
+        static void* thread_main(void*);
+
+    private:
+        // Data members.
+        std::unordered_map<int, std::string> m_dirs;
+        std::unordered_set<std::string> m_changed;
+        unsigned long long m_first, m_last;
+        std::string m_root;
+        FileCache* m_files;
+        ContentCache* m_cache;
+        Notifier m_notifier;
+        pthread_t m_thread;
+        bool m_running,
+             m_reset;
+        int m_inotify;
+    };
+
+#endif
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,617 @@
+/**
+ * Serverpp cache implementation
+ *
+ * Author: Mayank Sindwani
+ * Date: 2015-10-12
+ */
+
+#include <spp/cache.h>
+#include <spp/util.h>
+#include <spp/http.h>
+#include <zlib.h>
+
+using namespace spp;
+using namespace std;
+
+/**
+ * FileHandle Constructor
+ *
+ * @description Wraps an open file with one reference held by the creator.
+ * @param[in] {fd}   // The file descriptor.
+ * @param[in] {info} // The file metadata.
+ */
+FileHandle::FileHandle(int fd, const FileInfo& info)
+    : m_refs(1),
+      m_info(info),
+      m_fd(fd) {}
+
+/**
+ * FileHandle::release
+ *
+ * @description Drops a reference and closes the file after the last one.
+ */
+void FileHandle::release(void)
+{
+    if (--m_refs == 0)
+        delete this;
+}
+
+/**
+ * FileHandle::open
+ *
+ * @description Opens a regular file.
+ * @param[in] {path} // The file path.
+ * @returns // The handle (NULL on failure).
+ */
+FileHandle* FileHandle::open(const char* path)
+{
+    FileInfo info;
+    int fd;
+
+    if ((fd = open_file(path, &info)) < 0)
+        return NULL;
+
+    return new FileHandle(fd, info);
+}
+
+/**
+ * FileCache Constructor
+ *
+ * @description Creates an empty cache.
+ * @param[in] {entries} // The total number of paths to hold.
+ * @param[in] {ttl}     // The time to live of an entry in milliseconds
+ *                      // (0 to keep entries until invalidated).
+ */
+FileCache::FileCache(size_t entries, unsigned long long ttl)
+    : m_ttl(ttl),
+      m_entries((entries + SPP_CACHE_SHARDS - 1) / SPP_CACHE_SHARDS) {}
+
+/**
+ * FileCache Destructor
+ *
+ * @description Drops the cache's references.
+ */
+FileCache::~FileCache(void)
+{
+    Entry *entry, *older;
+    int i;
+
+    for (i = 0; i < SPP_CACHE_SHARDS; i++)
+    {
+        for (entry = m_shards[i].newest; entry != NULL; entry = older)
+        {
+            older = entry->older;
+
+            if (entry->handle != NULL)
+                entry->handle->release();
+
+            delete entry;
+        }
+    }
+}
+
+/**
+ * FileCache::get_shard
+ *
+ * @description Picks the shard for a path.
+ * @param[in] {path} // The resolved path.
+ * @returns // The shard.
+ */
+FileCache::Shard* FileCache::get_shard(const string& path)
+{
+    return &m_shards[hash<string>()(path) % SPP_CACHE_SHARDS];
+}
+
+/**
+ * FileCache::unlink
+ *
+ * @description Removes an entry from a shard and drops its reference. The
+ * shard must be locked.
+ * @param[out] {shard} // The shard.
+ * @param[out] {entry} // The entry.
+ */
+void FileCache::unlink(Shard* shard, Entry* entry)
+{
+    if (entry->newer) entry->newer->older = entry->older;
+    else              shard->newest = entry->older;
+
+    if (entry->older) entry->older->newer = entry->newer;
+    else              shard->oldest = entry->newer;
+
+    shard->index.erase(entry->path);
+
+    if (entry->handle != NULL)
+        entry->handle->release();
+
+    delete entry;
+}
+
+/**
+ * FileCache::open
+ *
+ * @description Opens a file through the cache. Failures are cached as
+ * well, so repeated requests for a missing file skip the open too.
+ * @param[in] {path} // The resolved path.
+ * @returns // A reference to the file (NULL if it cannot be opened).
+ */
+FileHandle* FileCache::open(const string& path)
+{
+    unordered_map<string, Entry*>::iterator it;
+    unsigned long long now, generation;
+    FileHandle* handle;
+    Shard* shard;
+    Entry* entry;
+
+    shard = get_shard(path);
+    now = get_ticks();
+    shard->lock.aquire();
+
+    if ((it = shard->index.find(path)) != shard->index.end())
+    {
+        if (m_ttl == 0 || now < it->second->expires)
+        {
+            if ((handle = it->second->handle) != NULL)
+                handle->retain();
+
+            shard->lock.release();
+            return handle;
+        }
+
+        unlink(shard, it->second);
+    }
+
+    generation = shard->generation;
+    shard->lock.release();
+
+    // Open the file without holding the shard.
+    handle = FileHandle::open(path.c_str());
+    shard->lock.aquire();
+
+    // Another thread may have opened it first. If the shard was invalidated
+    // meanwhile, the file may have changed after it was opened, so it is
+    // returned but not cached.
+    if (shard->generation == generation && shard->index.count(path) == 0)
+    {
+        if (shard->index.size() >= m_entries)
+            unlink(shard, shard->oldest);
+
+        entry = new Entry();
+        entry->path = path;
+        entry->handle = handle;
+        entry->expires = now + m_ttl;
+        entry->newer = NULL;
+        entry->older = shard->newest;
+
+        if (shard->newest) shard->newest->newer = entry;
+        else               shard->oldest = entry;
+
+        shard->newest = entry;
+        shard->index[path] = entry;
+
+        if (handle != NULL)
+            handle->retain();
+    }
+
+    shard->lock.release();
+    return handle;
+}
+
+/**
+ * FileCache::invalidate
+ *
+ * @description Drops a cached file. Connections still sending it keep
+ * their reference.
+ * @param[in] {path} // The resolved path.
+ */
+void FileCache::invalidate(const string& path)
+{
+    unordered_map<string, Entry*>::iterator it;
+    Shard* shard;
+
+    shard = get_shard(path);
+    shard->lock.aquire();
+    shard->generation++;
+
+    if ((it = shard->index.find(path)) != shard->index.end())
+        unlink(shard, it->second);
+
+    shard->lock.release();
+}
+
+/**
+ * FileCache::clear
+ *
+ * @description Drops every cached file.
+ */
+void FileCache::clear(void)
+{
+    int i;
+
+    for (i = 0; i < SPP_CACHE_SHARDS; i++)
+    {
+        m_shards[i].lock.aquire();
+        m_shards[i].generation++;
+
+        while (m_shards[i].oldest != NULL)
+            unlink(&m_shards[i], m_shards[i].oldest);
+
+        m_shards[i].lock.release();
+    }
+}
+
+/**
+ * CacheBuffer Constructor
+ *
+ * @description Allocates a body with one reference held by the creator.
+ * @param[in] {info} // The metadata of the file it was made from.
+ * @param[in] {size} // The body size.
+ */
+CacheBuffer::CacheBuffer(const FileInfo& info, size_t size)
+    : m_refs(1),
+      m_info(info),
+      m_size(size),
+      m_data(new char[size > 0 ? size : 1]) {}
+
+/**
+ * CacheBuffer::release
+ *
+ * @description Drops a reference and frees the body after the last one.
+ */
+void CacheBuffer::release(void)
+{
+    if (--m_refs == 0)
+        delete this;
+}
+
+/**
+ * ContentCache Constructor
+ *
+ * @description Creates an empty cache.
+ * @param[in] {budget}   // The total body size to hold.
+ * @param[in] {max_file} // The largest file to cache.
+ */
+ContentCache::ContentCache(size_t budget, size_t max_file)
+    : m_budget(budget / SPP_CACHE_SHARDS),
+      m_max_file(max_file < budget / SPP_CACHE_SHARDS ? max_file : budget / SPP_CACHE_SHARDS) {}
+
+/**
+ * ContentCache Destructor
+ *
+ * @description Drops the cache's references.
+ */
+ContentCache::~ContentCache(void)
+{
+    Entry *entry, *older;
+    int i;
+
+    for (i = 0; i < SPP_CACHE_SHARDS; i++)
+    {
+        for (entry = m_shards[i].newest; entry != NULL; entry = older)
+        {
+            older = entry->older;
+            entry->buffer->release();
+            delete entry;
+        }
+    }
+}
+
+/**
+ * ContentCache::get_shard
+ *
+ * @description Picks the shard for a path.
+ * @param[in] {path} // The resolved path.
+ * @returns // The shard.
+ */
+ContentCache::Shard* ContentCache::get_shard(const string& path)
+{
+    return &m_shards[hash<string>()(path) % SPP_CACHE_SHARDS];
+}
+
+/**
+ * ContentCache::unlink
+ *
+ * @description Removes an entry from a shard and drops its reference. The
+ * shard must be locked.
+ * @param[out] {shard} // The shard.
+ * @param[out] {entry} // The entry.
+ */
+void ContentCache::unlink(Shard* shard, Entry* entry)
+{
+    if (shard->hand == entry)
+        shard->hand = entry->newer;
+
+    if (entry->newer) entry->newer->older = entry->older;
+    else              shard->newest = entry->older;
+
+    if (entry->older) entry->older->newer = entry->newer;
+    else              shard->oldest = entry->newer;
+
+    shard->index.erase(entry->path);
+    shard->bytes -= entry->buffer->get_size();
+    entry->buffer->release();
+    delete entry;
+}
+
+/**
+ * ContentCache::evict
+ *
+ * @description Evicts entries until a body of the given size fits. The
+ * shard must be locked.
+ * @param[out] {shard} // The shard.
+ * @param[in]  {size}  // The size to make room for.
+ */
+void ContentCache::evict(Shard* shard, size_t size)
+{
+    Entry* entry;
+
+    while (shard->oldest != NULL && shard->bytes + size > m_budget)
+    {
+        // Resume the sweep where it stopped, wrapping to the oldest entry.
+        entry = shard->hand != NULL ? shard->hand : shard->oldest;
+
+        // Give recently used entries another pass.
+        while (entry->visited)
+        {
+            entry->visited = false;
+            entry = entry->newer != NULL ? entry->newer : shard->oldest;
+        }
+
+        shard->hand = entry;
+        unlink(shard, entry);
+    }
+}
+
+/**
+ * ContentCache::get_key
+ *
+ * @description Builds the key of a body. Encoded bodies are keyed past a
+ * NUL, which cannot appear in a path.
+ * @param[in] {path}     // The resolved path.
+ * @param[in] {encoding} // The SPP_ENCODING flag (0 for the file as is).
+ * @returns // The key.
+ */
+string ContentCache::get_key(const string& path, int encoding)
+{
+    string key;
+
+    if (encoding == 0)
+        return path;
+
+    key = path;
+    key.push_back('\0');
+    key.append(encoding == SPP_ENCODING_GZIP ? "gzip" : "br");
+    return key;
+}
+
+/**
+ * ContentCache::get
+ *
+ * @description Looks up a file body. An entry only hits if it was made
+ * from the same version of the file as the open handle.
+ * @param[in] {path}     // The resolved path.
+ * @param[in] {file}     // The open file.
+ * @param[in] {encoding} // The SPP_ENCODING flag (0 for the file as is).
+ * @returns // A reference to the body (NULL on a miss).
+ */
+CacheBuffer* ContentCache::get(const string& path, FileHandle* file, int encoding)
+{
+    unordered_map<string, Entry*>::iterator it;
+    const FileInfo& info = file->get_info();
+    CacheBuffer* buffer;
+    Shard* shard;
+    string key;
+
+    key = get_key(path, encoding);
+    shard = get_shard(key);
+    shard->lock.aquire();
+
+    if ((it = shard->index.find(key)) == shard->index.end())
+    {
+        shard->lock.release();
+        return NULL;
+    }
+
+    buffer = it->second->buffer;
+
+    // The file changed.
+    if (buffer->m_info.size != info.size || buffer->m_info.mtime != info.mtime || buffer->m_info.inode != info.inode)
+    {
+        unlink(shard, it->second);
+        shard->lock.release();
+        return NULL;
+    }
+
+    buffer->retain();
+    it->second->visited = true;
+    shard->lock.release();
+    return buffer;
+}
+
+/**
+ * ContentCache::insert
+ *
+ * @description Caches a body unless another thread cached one first.
+ * @param[in] {key}    // The key.
+ * @param[in] {buffer} // A reference to the body, which the caller keeps.
+ * @returns // The body.
+ */
+CacheBuffer* ContentCache::insert(const string& key, CacheBuffer* buffer)
+{
+    Shard* shard;
+    Entry* entry;
+
+    shard = get_shard(key);
+    shard->lock.aquire();
+
+    if (shard->index.count(key) == 0)
+    {
+        evict(shard, buffer->m_size);
+
+        entry = new Entry();
+        entry->path = key;
+        entry->buffer = buffer;
+        entry->visited = false;
+        entry->newer = NULL;
+        entry->older = shard->newest;
+
+        if (shard->newest) shard->newest->newer = entry;
+        else               shard->oldest = entry;
+
+        shard->newest = entry;
+        shard->index[key] = entry;
+        shard->bytes += buffer->m_size;
+        buffer->retain();
+    }
+
+    shard->lock.release();
+    return buffer;
+}
+
+/**
+ * ContentCache::load
+ *
+ * @description Reads an open file and caches it if it fits.
+ * @param[in] {path} // The resolved path.
+ * @param[in] {file} // The open file.
+ * @returns // A reference to the body (NULL if the file cannot be read
+ *          // or is too large to cache).
+ */
+CacheBuffer* ContentCache::load(const string& path, FileHandle* file)
+{
+    CacheBuffer* buffer;
+    long read_bytes;
+    size_t offset;
+    size_t size;
+
+    if ((size = file->get_size()) > m_max_file)
+        return NULL;
+
+    // Read the whole file into an immutable buffer.
+    buffer = new CacheBuffer(file->get_info(), size);
+
+    for (offset = 0; offset < size; offset += read_bytes)
+    {
+        if ((read_bytes = read_file_at(file->get_fd(), buffer->m_data + offset, size - offset, offset)) <= 0)
+        {
+            buffer->release();
+            return NULL;
+        }
+    }
+
+    return insert(path, buffer);
+}
+
+/**
+ * ContentCache::compress
+ *
+ * @description Gzips an open file and caches the result next to the file
+ * as is, so each version of a file is compressed once. A result that is
+ * not smaller than the file is cached as an empty body, which tells the
+ * caller to send the file as is.
+ * @param[in] {path}  // The resolved path.
+ * @param[in] {file}  // The open file.
+ * @param[in] {level} // The zlib compression level.
+ * @returns // A reference to the compressed body (NULL if the file cannot
+ *          // be read or is too large to cache).
+ */
+CacheBuffer* ContentCache::compress(const string& path, FileHandle* file, int level)
+{
+    CacheBuffer *identity, *buffer;
+    z_stream stream;
+    uLong bound;
+    char* output;
+    size_t size;
+    int rtn;
+
+    if ((identity = get(path, file)) == NULL && (identity = load(path, file)) == NULL)
+        return NULL;
+
+    memset(&stream, 0, sizeof(stream));
+
+    // A window of 15 bits plus 16 selects the gzip wrapper.
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        identity->release();
+        return NULL;
+    }
+
+    bound = deflateBound(&stream, (uLong)identity->m_size);
+    output = new char[bound];
+
+    stream.next_in = (Bytef*)identity->m_data;
+    stream.avail_in = (uInt)identity->m_size;
+    stream.next_out = (Bytef*)output;
+    stream.avail_out = (uInt)bound;
+
+    rtn = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+
+    if (rtn != Z_STREAM_END)
+    {
+        identity->release();
+        delete[] output;
+        return NULL;
+    }
+
+    // Keep only the compressed bytes, since the cache budget counts them.
+    size = stream.total_out < identity->m_size ? stream.total_out : 0;
+    buffer = new CacheBuffer(identity->m_info, size);
+    memcpy(buffer->m_data, output, size);
+    identity->release();
+    delete[] output;
+
+    return insert(get_key(path, SPP_ENCODING_GZIP), buffer);
+}
+
+/**
+ * ContentCache::remove
+ *
+ * @description Drops the body with a key.
+ * @param[in] {key} // The key.
+ */
+void ContentCache::remove(const string& key)
+{
+    unordered_map<string, Entry*>::iterator it;
+    Shard* shard;
+
+    shard = get_shard(key);
+    shard->lock.aquire();
+
+    if ((it = shard->index.find(key)) != shard->index.end())
+        unlink(shard, it->second);
+
+    shard->lock.release();
+}
+
+/**
+ * ContentCache::invalidate
+ *
+ * @description Drops the cached bodies of a file. Connections still
+ * sending them keep their reference.
+ * @param[in] {path} // The resolved path.
+ */
+void ContentCache::invalidate(const string& path)
+{
+    remove(path);
+    remove(get_key(path, SPP_ENCODING_GZIP));
+}
+
+/**
+ * ContentCache::clear
+ *
+ * @description Drops every cached file body.
+ */
+void ContentCache::clear(void)
+{
+    int i;
+
+    for (i = 0; i < SPP_CACHE_SHARDS; i++)
+    {
+        m_shards[i].lock.aquire();
+
+        while (m_shards[i].oldest != NULL)
+            unlink(&m_shards[i], m_shards[i].oldest);
+
+        m_shards[i].lock.release();
+    }
+}
\ No newline at end of file
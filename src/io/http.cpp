@@ -5,65 +5,660 @@
  * Date: 2015-09-18
  */
 
-#include <spp\http.h>
+#include <spp/http.h>
+#include <spp/token.h>
+#include <ctype.h>
+
+#if defined(SPP_WINDOWS)
+    #define strncasecmp _strnicmp
+#else
+    #include <strings.h>
+#endif
 
 using namespace spp;
 using namespace std;
 
 /**
- * HTTPRequest Constructor
+ * get_reason
  *
- * @description Parses the HTTP request and stores required information.
- * @param[out] {request} // The request string.
- * @param[out] {size}    // The size of the request.
+ * @description Returns the reason phrase for a status code.
+ * @param[in] {code} // The status code.
+ * @returns // The reason phrase.
  */
-HTTPRequest::HTTPRequest(char* request, size_t size)
+const char* spp::get_reason(status code)
 {
-    char *key, *value, *next;
-    string uri, query;
-    int pos, cpos;
+    switch (code)
+    {
+    case OK:                    return "OK";
+    case PARTIAL_CONTENT:       return "Partial Content";
+    case FOUND:                 return "Found";
+    case NOT_MODIFIED:          return "Not Modified";
+    case BAD_REQUEST:           return "Bad Request";
+    case FORBIDDEN:             return "Forbidden";
+    case NOT_FOUND:             return "Not Found";
+    case RANGE_NOT_SATISFIABLE: return "Range Not Satisfiable";
+    case INTERNAL_SERVER_ERROR: return "Internal Server Error";
+    case SERVICE_UNAVAILABLE:   return "Service Unavailable";
+    }
 
-    cpos = 0;
+    return "Unknown";
+}
 
-    // Parse the request line. We don't need other headers at the moment.
-    m_method = string(request, trim(&request, size, &cpos));
-         uri = string(request, trim(&request, size, &cpos));
-  m_protocol = string(request, trim(&request, size, &cpos));
+/**
+ * is_token
+ *
+ * @description Returns whether a character may appear in a method or header name.
+ * @param[in] {c} // The character.
+ * @returns // True if it is a token character; false otherwise.
+ */
+static inline bool is_token(char c)
+{
+    return isalnum((unsigned char)c) || (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
 
-  m_uri = uri;
+/**
+ * decode
+ *
+ * @description Decodes percent-encoded octets in a query component.
+ * @param[in] {data} // The encoded component.
+ * @param[in] {size} // The component size.
+ * @returns // The decoded component.
+ */
+static string decode(const char* data, size_t size)
+{
+    char octet[3] = { 0 };
+    size_t start, end;
+    string result;
 
-  // Parse query string parameters.
-  if ((pos = m_uri.find_first_of("?")) != string::npos)
-  {
-      m_uri = uri.substr(0, pos++);
-      query = uri.substr(pos, uri.length());
+    for (start = 0; start < size; start = end + 1)
+    {
+        // Copy the run up to the next escape.
+        end = start + find_token(data + start, size - start, SPP_TOKEN_PERCENT);
+        result.append(data + start, end - start);
 
-      // Get key.
-#if defined(_MSC_VER)
-      key = strtok_s((char*)query.c_str(), "=", &next);
-#else
-      key = strtok((char*)query.c_str(), "=");
-#endif
-      while (key != NULL)
-      {
-          // Get value.
-#if defined(_MSC_VER)
-          value = strtok_s(NULL, "&", &next);
-#else
-          value = strtok(NULL, "&");
-#endif
-          if (value == NULL)
-              break;
+        if (end == size)
+            break;
 
-          // Store the key value pair.
-          m_params[key] = value;
-#if defined(_MSC_VER)
-          key = strtok_s(NULL, "=", &next);
-#else
-          key = strtok(NULL, "=");
-#endif
-      }
-  }
+        if (end + 2 < size && isxdigit((unsigned char)data[end + 1]) && isxdigit((unsigned char)data[end + 2]))
+        {
+            octet[0] = data[end + 1];
+            octet[1] = data[end + 2];
+            result += (char)strtol(octet, NULL, 16);
+            end += 2;
+        }
+        else
+        {
+            result += '%';
+        }
+    }
+
+    return result;
+}
+
+/**
+ * HTTPView::equals
+ *
+ * @description Compares the view with a string, ignoring case.
+ * @param[out] {str} // The string.
+ * @returns // True if they are equal; false otherwise.
+ */
+bool HTTPView::equals(const char* str) const
+{
+    return strlen(str) == size && strncasecmp(data, str, size) == 0;
+}
+
+/**
+ * HTTPView::contains
+ *
+ * @description Searches the view for a string, ignoring case.
+ * @param[out] {str} // The string.
+ * @returns // True if the string is found; false otherwise.
+ */
+bool HTTPView::contains(const char* str) const
+{
+    size_t i, length;
+
+    length = strlen(str);
+
+    for (i = 0; i + length <= size; i++)
+    {
+        if (strncasecmp(data + i, str, length) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * HTTPRequest::reset
+ *
+ * @description Prepares the parser for the next request.
+ */
+void HTTPRequest::reset(void)
+{
+    m_method.data = m_protocol.data = m_query.data = m_uri.data = "";
+    m_method.size = m_protocol.size = m_query.size = m_uri.size = 0;
+    m_state = METHOD;
+    m_offset = 0;
+    m_start = 0;
+    m_size = 0;
+    m_count = 0;
+}
+
+/**
+ * HTTPRequest::parse
+ *
+ * @description Consumes received bytes and resumes where the last call
+ * stopped. The buffer must start with the request and may grow between
+ * calls, but must not move.
+ * @param[out] {buffer} // The receive buffer.
+ * @param[in]  {size}   // The number of received bytes.
+ * @returns // SPP_HTTP_PARSE_DONE, SPP_HTTP_PARSE_AGAIN or SPP_HTTP_PARSE_ERROR.
+ */
+int HTTPRequest::parse(const char* buffer, size_t size)
+{
+    const HTTPView* length;
+    HTTPHeader* header;
+    size_t i, end;
+    char c;
+
+    while (m_offset < size && m_state < BODY)
+    {
+        switch (m_state)
+        {
+        case METHOD:
+            c = buffer[m_offset];
+
+            if (c == ' ' && m_offset > m_start)
+            {
+                m_method.data = buffer + m_start;
+                m_method.size = m_offset - m_start;
+                m_start = m_offset + 1;
+                m_state = URI;
+            }
+            else if (!is_token(c))
+            {
+                return SPP_HTTP_PARSE_ERROR;
+            }
+            break;
+
+        case URI:
+            // Skip to the end of the target.
+            m_offset += find_token(buffer + m_offset, size - m_offset, SPP_TOKEN_SP | SPP_TOKEN_CRLF);
+
+            if (m_offset == size)
+                continue;
+
+            if (buffer[m_offset] != ' ' || m_offset == m_start)
+                return SPP_HTTP_PARSE_ERROR;
+
+            // Split the query string from the path.
+            m_uri.data = buffer + m_start;
+            m_uri.size = m_offset - m_start;
+            i = find_token(m_uri.data, m_uri.size, SPP_TOKEN_QUERY);
+
+            if (i < m_uri.size)
+            {
+                m_query.data = m_uri.data + i + 1;
+                m_query.size = m_uri.size - i - 1;
+                m_uri.size = i;
+            }
+
+            m_start = m_offset + 1;
+            m_state = PROTOCOL;
+            break;
+
+        case PROTOCOL:
+            m_offset += find_token(buffer + m_offset, size - m_offset, SPP_TOKEN_CRLF);
+
+            if (m_offset == size)
+                continue;
+
+            m_protocol.data = buffer + m_start;
+            m_protocol.size = m_offset - m_start;
+
+            if (m_protocol.size < 8 || strncmp(m_protocol.data, "HTTP/", 5) != 0)
+                return SPP_HTTP_PARSE_ERROR;
+
+            m_state = buffer[m_offset] == '\r' ? REQUEST_LINE_LF : HEADER_START;
+            break;
+
+        case REQUEST_LINE_LF:
+        case HEADER_LF:
+            if (buffer[m_offset] != '\n')
+                return SPP_HTTP_PARSE_ERROR;
+
+            m_state = HEADER_START;
+            break;
+
+        case HEADER_START:
+            c = buffer[m_offset];
+
+            if (c == '\r')
+            {
+                m_state = HEADERS_LF;
+            }
+            else if (c == '\n')
+            {
+                m_state = BODY;
+            }
+            else if (is_token(c))
+            {
+                if (m_count == SPP_HTTP_MAX_HEADERS)
+                    return SPP_HTTP_PARSE_ERROR;
+
+                m_start = m_offset;
+                m_state = HEADER_NAME;
+            }
+            else
+            {
+                return SPP_HTTP_PARSE_ERROR;
+            }
+            break;
+
+        case HEADER_NAME:
+            m_offset += find_token(buffer + m_offset, size - m_offset, SPP_TOKEN_COLON | SPP_TOKEN_CRLF);
+
+            if (m_offset == size)
+                continue;
+
+            if (buffer[m_offset] != ':')
+                return SPP_HTTP_PARSE_ERROR;
+
+            // Names are short, so validate them once they are delimited.
+            for (i = m_start; i < m_offset; i++)
+            {
+                if (!is_token(buffer[i]))
+                    return SPP_HTTP_PARSE_ERROR;
+            }
+
+            header = &m_headers[m_count];
+            header->name.data = buffer + m_start;
+            header->name.size = m_offset - m_start;
+            m_state = HEADER_VALUE_WS;
+            break;
+
+        case HEADER_VALUE_WS:
+            c = buffer[m_offset];
+
+            if (c == ' ' || c == '\t')
+                break;
+
+            m_start = m_offset;
+            m_state = HEADER_VALUE;
+            continue;
+
+        case HEADER_VALUE:
+            m_offset += find_token(buffer + m_offset, size - m_offset, SPP_TOKEN_CRLF);
+
+            if (m_offset == size)
+                continue;
+
+            // Trim trailing whitespace from the value.
+            for (end = m_offset; end > m_start && (buffer[end - 1] == ' ' || buffer[end - 1] == '\t'); end--);
+
+            header = &m_headers[m_count++];
+            header->value.data = buffer + m_start;
+            header->value.size = end - m_start;
+            m_state = buffer[m_offset] == '\r' ? HEADER_LF : HEADER_START;
+            break;
+
+        case HEADERS_LF:
+            if (buffer[m_offset] != '\n')
+                return SPP_HTTP_PARSE_ERROR;
+
+            m_state = BODY;
+            break;
+
+        default:
+            break;
+        }
+
+        m_offset++;
+    }
+
+    if (m_state < BODY)
+        return SPP_HTTP_PARSE_AGAIN;
+
+    // The request ends after its body.
+    if (m_state == BODY)
+    {
+        m_size = 0;
+
+        if ((length = get_header("content-length")) != NULL)
+        {
+            if (length->size == 0 || length->size > 9)
+                return SPP_HTTP_PARSE_ERROR;
+
+            for (i = 0; i < length->size; i++)
+            {
+                if (!isdigit((unsigned char)length->data[i]))
+                    return SPP_HTTP_PARSE_ERROR;
+
+                m_size = m_size * 10 + (length->data[i] - '0');
+            }
+        }
+        else if (get_header("transfer-encoding") != NULL)
+        {
+            return SPP_HTTP_PARSE_ERROR;
+        }
+
+        m_size += m_offset;
+        m_state = DONE;
+    }
+
+    return size >= m_size ? SPP_HTTP_PARSE_DONE : SPP_HTTP_PARSE_AGAIN;
+}
+
+/**
+ * HTTPRequest::get_header
+ *
+ * @description Returns a header field value.
+ * @param[out] {name} // The field name (case insensitive).
+ * @returns // The field value (NULL if not present).
+ */
+const HTTPView* HTTPRequest::get_header(const char* name)
+{
+    int i;
+
+    for (i = 0; i < m_count; i++)
+    {
+        if (m_headers[i].name.equals(name))
+            return &m_headers[i].value;
+    }
+
+    return NULL;
+}
+
+/**
+ * HTTPRequest::get_encodings
+ *
+ * @description Parses the Accept-Encoding field. Codings with a zero
+ * quality are refused, and a wildcard accepts the codings that are not
+ * listed.
+ * @returns // The accepted SPP_ENCODING flags.
+ */
+int HTTPRequest::get_encodings(void)
+{
+    int accepted, listed, wildcard, flag;
+    size_t start, end, name, q;
+    const HTTPView* field;
+    HTTPView coding;
+    bool refused;
+
+    if ((field = get_header("Accept-Encoding")) == NULL)
+        return 0;
+
+    accepted = listed = wildcard = 0;
+
+    for (start = 0; start < field->size; start = end + 1)
+    {
+        for (end = start; end < field->size && field->data[end] != ','; end++);
+
+        // Trim the element and split off its parameters.
+        while (start < end && (field->data[start] == ' ' || field->data[start] == '\t'))
+            start++;
+
+        for (name = start; name < end && field->data[name] != ';' && field->data[name] != ' ' && field->data[name] != '\t'; name++);
+
+        coding.data = field->data + start;
+        coding.size = name - start;
+
+        // A quality of zero means "not acceptable".
+        refused = false;
+
+        for (q = name; q + 2 < end; q++)
+        {
+            if ((field->data[q] == 'q' || field->data[q] == 'Q') && field->data[q + 1] == '=')
+            {
+                for (q += 2, refused = true; q < end && field->data[q] != ' ' && field->data[q] != '\t'; q++)
+                {
+                    if (field->data[q] != '0' && field->data[q] != '.')
+                        refused = false;
+                }
+
+                break;
+            }
+        }
+
+        if (coding.equals("br"))
+            flag = SPP_ENCODING_BR;
+        else if (coding.equals("gzip") || coding.equals("x-gzip"))
+            flag = SPP_ENCODING_GZIP;
+        else if (coding.equals("*"))
+        {
+            wildcard = refused ? 0 : SPP_ENCODING_ALL;
+            continue;
+        }
+        else
+            continue;
+
+        listed |= flag;
+
+        if (!refused)
+            accepted |= flag;
+    }
+
+    return accepted | (wildcard & ~listed);
+}
+
+/**
+ * HTTPRequest::is_not_modified
+ *
+ * @description Evaluates If-None-Match, or If-Modified-Since when it is
+ * absent, against the current validators of the resource.
+ * @param[in] {etag}  // The entity tag, including its quotes.
+ * @param[in] {mtime} // The modification time.
+ * @returns // True if the client's copy is current; false otherwise.
+ */
+bool HTTPRequest::is_not_modified(const char* etag, long long mtime)
+{
+    size_t start, end, length;
+    const HTTPView* field;
+    long long since;
+
+    if ((field = get_header("If-None-Match")) != NULL)
+    {
+        length = strlen(etag);
+
+        for (start = 0; start < field->size; start = end + 1)
+        {
+            for (end = start; end < field->size && field->data[end] != ','; end++);
+
+            // Trim the element and compare weakly, ignoring any W/ prefix.
+            while (start < end && (field->data[start] == ' ' || field->data[start] == '\t'))
+                start++;
+
+            while (end > start && (field->data[end - 1] == ' ' || field->data[end - 1] == '\t'))
+                end--;
+
+            if (end - start == 1 && field->data[start] == '*')
+                return true;
+
+            if (end - start > 2 && field->data[start] == 'W' && field->data[start + 1] == '/')
+                start += 2;
+
+            if (end - start == length && memcmp(field->data + start, etag, length) == 0)
+                return true;
+
+            // Step past the trimmed whitespace to the comma.
+            for (; end < field->size && field->data[end] != ','; end++);
+        }
+
+        return false;
+    }
+
+    if ((field = get_header("If-Modified-Since")) != NULL)
+        return parse_http_date(field->data, field->size, &since) && mtime <= since;
+
+    return false;
+}
+
+/**
+ * HTTPRequest::is_range_current
+ *
+ * @description Evaluates If-Range against the current validators of the
+ * resource. Entity tags must match strongly and dates exactly.
+ * @param[in] {etag}  // The entity tag, including its quotes.
+ * @param[in] {mtime} // The modification time.
+ * @returns // True if the Range field applies; false otherwise.
+ */
+bool HTTPRequest::is_range_current(const char* etag, long long mtime)
+{
+    const HTTPView* field;
+    long long date;
+
+    if ((field = get_header("If-Range")) == NULL)
+        return true;
+
+    if (field->size > 0 && field->data[0] == '"')
+        return field->size == strlen(etag) && memcmp(field->data, etag, field->size) == 0;
+
+    return parse_http_date(field->data, field->size, &date) && date == mtime;
+}
+
+/**
+ * HTTPRequest::get_ranges
+ *
+ * @description Parses the Range field against a representation. Invalid
+ * fields and requests for more ranges than fit are ignored, so the whole
+ * representation is sent instead.
+ * @param[in]  {size}   // The size of the representation.
+ * @param[out] {ranges} // The satisfiable ranges in request order.
+ * @param[in]  {max}    // The number of ranges that fit.
+ * @returns // The number of ranges (0 to ignore the field or -1 if none
+ *          // are satisfiable).
+ */
+int HTTPRequest::get_ranges(size_t size, HTTPRange* ranges, int max)
+{
+    unsigned long long first, last;
+    size_t start, end, i, digits;
+    const HTTPView* field;
+    bool suffix, open;
+    int count, parsed;
+
+    if ((field = get_header("Range")) == NULL || field->size < 6 || strncasecmp(field->data, "bytes=", 6) != 0)
+        return 0;
+
+    count = parsed = 0;
+
+    for (start = 6; start < field->size; start = end + 1)
+    {
+        for (end = start; end < field->size && field->data[end] != ','; end++);
+
+        while (start < end && (field->data[start] == ' ' || field->data[start] == '\t'))
+            start++;
+
+        // Empty list elements are allowed.
+        if (start == end)
+            continue;
+
+        // Parse "first-last", "first-" or "-suffix".
+        suffix = field->data[start] == '-';
+        first = last = 0;
+        i = suffix ? start + 1 : start;
+
+        for (digits = 0; i < end && isdigit((unsigned char)field->data[i]); i++, digits++)
+            first = first * 10 + (field->data[i] - '0');
+
+        if (digits == 0 || digits > 18)
+            return 0;
+
+        open = true;
+
+        if (!suffix)
+        {
+            if (i == end || field->data[i++] != '-')
+                return 0;
+
+            for (digits = 0; i < end && isdigit((unsigned char)field->data[i]); i++, digits++)
+                last = last * 10 + (field->data[i] - '0');
+
+            if (digits > 18 || (digits > 0 && last < first))
+                return 0;
+
+            open = digits == 0;
+        }
+
+        while (i < end && (field->data[i] == ' ' || field->data[i] == '\t'))
+            i++;
+
+        if (i != end)
+            return 0;
+
+        parsed++;
+
+        // Skip ranges that start past the end.
+        if (suffix ? first == 0 || size == 0 : first >= size)
+            continue;
+
+        if (count == max)
+            return 0;
+
+        if (suffix)
+        {
+            ranges[count].offset = first < size ? size - (size_t)first : 0;
+            ranges[count].size = size - ranges[count].offset;
+        }
+        else
+        {
+            ranges[count].offset = (size_t)first;
+            ranges[count].size = (open || last >= size ? size - 1 : (size_t)last) - (size_t)first + 1;
+        }
+
+        count++;
+    }
+
+    if (parsed == 0)
+        return 0;
+
+    return count > 0 ? count : -1;
+}
+
+/**
+ * HTTPRequest::get_params
+ *
+ * @description Decodes the query string parameters.
+ * @returns // The parameters.
+ */
+map<string, string> HTTPRequest::get_params(void)
+{
+    map<string, string> params;
+    size_t start, end, equals;
+
+    for (start = 0; start < m_query.size; start = end + 1)
+    {
+        // Find the end of the pair and its separator.
+        end = start + find_token(m_query.data + start, m_query.size - start, SPP_TOKEN_AMP);
+        equals = start + find_token(m_query.data + start, end - start, SPP_TOKEN_EQUALS);
+
+        if (equals < end)
+        {
+            params[decode(m_query.data + start, equals - start)] =
+                decode(m_query.data + equals + 1, end - equals - 1);
+        }
+    }
+
+    return params;
+}
+
+/**
+ * HTTPRequest::is_keep_alive
+ *
+ * @description Returns whether the client asked to keep the connection open.
+ * HTTP/1.1 connections persist unless closed; HTTP/1.0 ones must opt in.
+ * @returns // True if the connection should persist; false otherwise.
+ */
+bool HTTPRequest::is_keep_alive(void)
+{
+    const HTTPView* connection;
+
+    connection = get_header("connection");
+
+    if (m_protocol.equals("HTTP/1.1"))
+        return connection == NULL || !connection->contains("close");
+
+    return connection != NULL && connection->contains("keep-alive");
 }
 
 /**
@@ -129,7 +724,7 @@ string HTTPLocation::get_path(HTTPRequest* request)
     string path;
 
     params = request->get_params();
-    path = m_aliased ? m_root + m_index : m_root + request->get_uri();
+    path = m_aliased ? m_root + m_index : m_root + request->get_uri().str();
     render_template(path, &params);
 
     return path;
@@ -165,18 +760,25 @@ void HTTPUriMap::set_location(const char* type, const char* key, HTTPLocation* l
         // Create a regex rule for locations.
         if (!strcmp(SPP_HTTP_REGEX, type))
         {
-            m_expressions.push_back(make_pair(regex(key), location));
+            m_expression_patterns.add(key);
+            m_expressions.push_back(location);
         }
         // Create a regex rule for errors.
         else if (!strcmp(SPP_HTTP_ERROR, type) && !location->is_proxied())
         {
-            m_errors.push_back(make_pair(regex(key), location));
+            m_error_patterns.add(key);
+            m_errors.push_back(location);
         }
-        // Add the rule to the suffix tree.
+        // Add the rule to the radix tree.
         else if (!strcmp(SPP_HTTP_MAP, type))
         {
             m_locations.set(key, location);
         }
+        // Add the prefix rule to the radix tree.
+        else if (!strcmp(SPP_HTTP_PREFIX, type))
+        {
+            m_locations.set_prefix(key, location);
+        }
     }
     catch (regex_error)
     {
@@ -193,22 +795,17 @@ void HTTPUriMap::set_location(const char* type, const char* key, HTTPLocation* l
  */
 char* HTTPUriMap::get_error(const char* key, size_t* size)
 {
-    list< pair<regex, HTTPLocation*> >::iterator it;
     map<string, string> m_params;
     string path;
+    int i;
 
-    // Compare against each regex.
-    for (it = m_errors.begin(); it != m_errors.end(); it++)
-    {
-        if (regex_match(key, it->first))
-        {
-            m_params["code"] = key;
-            path = it->second->get_path(&m_params);
-            return read_file(path.c_str(), size);
-        }
-    }
+    // Find the first matching regex.
+    if ((i = m_error_patterns.match(key, strlen(key))) < 0)
+        return NULL;
 
-    return NULL;
+    m_params["code"] = key;
+    path = m_errors[i]->get_path(&m_params);
+    return read_file(path.c_str(), size);
 }
 
 /**
@@ -220,22 +817,31 @@ char* HTTPUriMap::get_error(const char* key, size_t* size)
  */
 HTTPLocation* HTTPUriMap::get_location(HTTPRequest* request)
 {
-    list< pair<regex, HTTPLocation*> >::iterator it;
     HTTPLocation* location;
-    string uri;
+    HTTPView uri;
+    int i;
 
-    // First do a direct string comparision.
+    // First do a direct string comparision, then the longest prefix.
     uri = request->get_uri();
 
     // If not found, compare each regex.
-    if ((location = m_locations.get(uri.c_str())) == NULL)
+    if ((location = m_locations.match(uri.data, uri.size)) == NULL)
     {
-        for (it = m_expressions.begin(); it != m_expressions.end(); it++)
-        {
-            if (regex_match(uri, it->first))
-                return it->second;
-        }
+        if ((i = m_expression_patterns.match(uri.data, uri.size)) >= 0)
+            return m_expressions[i];
     }
 
     return location;
+}
+
+/**
+ * HTTPUriMap::compile
+ *
+ * @description Compiles the location and error regexes after the last one
+ *              is set.
+ */
+void HTTPUriMap::compile(void)
+{
+    m_expression_patterns.compile();
+    m_error_patterns.compile();
 }
\ No newline at end of file
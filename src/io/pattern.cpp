@@ -0,0 +1,846 @@
+/**
+ * Serverpp pattern implementation
+ *
+ * Author: Mayank Sindwani
+ * Date: 2015-10-17
+ */
+
+#include <spp/pattern.h>
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+
+using namespace spp;
+using namespace std;
+
+// Automaton state types.
+enum { PATTERN_SET, PATTERN_SPLIT, PATTERN_MATCH };
+
+// Syntax tree node types.
+enum { PATTERN_NODE_SET, PATTERN_NODE_CAT, PATTERN_NODE_ALT, PATTERN_NODE_REPEAT };
+
+/**
+ * PatternNode: A parsed expression. Sets refer to byte sets by index and
+ * repeats have a single child (max is -1 when unbounded).
+ */
+struct spp::PatternNode
+{
+    PatternNode(int t = PATTERN_NODE_CAT) : type(t), set(0), min(0), max(0) {}
+
+    int type, set, min, max;
+    vector<PatternNode> children;
+};
+
+/**
+ * PatternParser: Parses the subset of ECMAScript syntax that describes a
+ * regular language: literals, escapes, classes, groups, alternation and
+ * quantifiers. Anchors are accepted only at the ends of the expression,
+ * where they always hold for a whole-input match.
+ */
+class PatternParser
+{
+public:
+    // Constructor.
+    PatternParser(const char* pattern, vector< bitset<256> >* sets)
+        : m_pos(pattern),
+          m_end(pattern + strlen(pattern)),
+          m_sets(sets) {}
+
+public:
+    // Member functions.
+    bool parse(PatternNode*);
+
+private:
+    // Helper functions.
+    bool parse_alt(PatternNode*);
+    bool parse_cat(PatternNode*);
+    bool parse_atom(PatternNode*);
+    bool parse_quantifier(PatternNode*);
+    bool parse_class(PatternNode*);
+    bool parse_class_atom(bitset<256>*, int*);
+    bool parse_escape(bitset<256>*, bool);
+    bool parse_number(int*);
+    void set_node(PatternNode*, const bitset<256>&);
+
+private:
+    // Data members.
+    const char *m_pos, *m_end;
+    vector< bitset<256> >* m_sets;
+};
+
+/**
+ * PatternParser::parse
+ *
+ * @description Parses the whole expression.
+ * @param[out] {root} // The syntax tree.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse(PatternNode* root)
+{
+    const char* escape;
+
+    if (m_pos < m_end && *m_pos == '^')
+        m_pos++;
+
+    // A trailing $ is an anchor unless it is escaped.
+    if (m_end > m_pos && m_end[-1] == '$')
+    {
+        for (escape = m_end - 1; escape > m_pos && escape[-1] == '\\'; escape--);
+
+        if ((m_end - 1 - escape) % 2 == 0)
+            m_end--;
+    }
+
+    return parse_alt(root) && m_pos == m_end;
+}
+
+/**
+ * PatternParser::parse_alt
+ *
+ * @description Parses alternatives separated by '|'.
+ * @param[out] {node} // The parsed node.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_alt(PatternNode* node)
+{
+    PatternNode branch;
+
+    if (!parse_cat(&branch))
+        return false;
+
+    if (m_pos == m_end || *m_pos != '|')
+    {
+        *node = branch;
+        return true;
+    }
+
+    *node = PatternNode(PATTERN_NODE_ALT);
+    node->children.push_back(branch);
+
+    while (m_pos < m_end && *m_pos == '|')
+    {
+        m_pos++;
+        node->children.push_back(PatternNode());
+
+        if (!parse_cat(&node->children.back()))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * PatternParser::parse_cat
+ *
+ * @description Parses a sequence of quantified atoms.
+ * @param[out] {node} // The parsed node.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_cat(PatternNode* node)
+{
+    *node = PatternNode(PATTERN_NODE_CAT);
+
+    while (m_pos < m_end && *m_pos != '|' && *m_pos != ')')
+    {
+        node->children.push_back(PatternNode());
+
+        if (!parse_atom(&node->children.back()) || !parse_quantifier(&node->children.back()))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * PatternParser::parse_atom
+ *
+ * @description Parses a character, class or group.
+ * @param[out] {node} // The parsed node.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_atom(PatternNode* node)
+{
+    bitset<256> set;
+
+    switch (*m_pos++)
+    {
+    case '(':
+        // Only non-capturing groups change nothing about the language.
+        if (m_pos < m_end && *m_pos == '?')
+        {
+            if (m_end - m_pos < 2 || m_pos[1] != ':')
+                return false;
+
+            m_pos += 2;
+        }
+
+        if (!parse_alt(node) || m_pos == m_end)
+            return false;
+
+        m_pos++;
+        return true;
+
+    case '[':
+        return parse_class(node);
+
+    case '.':
+        set.set();
+        set.reset('\n');
+        set.reset('\r');
+        break;
+
+    case '\\':
+        if (!parse_escape(&set, false))
+            return false;
+        break;
+
+    case '^': case '$': case '*': case '+': case '?': case '{':
+        return false;
+
+    default:
+        set.set((unsigned char)m_pos[-1]);
+        break;
+    }
+
+    set_node(node, set);
+    return true;
+}
+
+/**
+ * PatternParser::parse_quantifier
+ *
+ * @description Parses an optional quantifier and wraps the atom in it.
+ * @param[in/out] {node} // The atom.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_quantifier(PatternNode* node)
+{
+    PatternNode repeat(PATTERN_NODE_REPEAT);
+
+    if (m_pos == m_end)
+        return true;
+
+    switch (*m_pos)
+    {
+    case '*': repeat.min = 0; repeat.max = -1; m_pos++; break;
+    case '+': repeat.min = 1; repeat.max = -1; m_pos++; break;
+    case '?': repeat.min = 0; repeat.max = 1;  m_pos++; break;
+
+    case '{':
+        m_pos++;
+
+        if (!parse_number(&repeat.min))
+            return false;
+
+        repeat.max = repeat.min;
+
+        if (m_pos < m_end && *m_pos == ',')
+        {
+            m_pos++;
+            repeat.max = -1;
+
+            if (m_pos < m_end && *m_pos != '}' && !parse_number(&repeat.max))
+                return false;
+        }
+
+        if (m_pos == m_end || *m_pos++ != '}' || (repeat.max >= 0 && repeat.max < repeat.min))
+            return false;
+        break;
+
+    default:
+        return true;
+    }
+
+    // Laziness does not change what matches the whole input.
+    if (m_pos < m_end && *m_pos == '?')
+        m_pos++;
+
+    repeat.children.push_back(*node);
+    *node = repeat;
+    return true;
+}
+
+/**
+ * PatternParser::parse_class
+ *
+ * @description Parses a bracket expression after the '['.
+ * @param[out] {node} // The parsed node.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_class(PatternNode* node)
+{
+    bitset<256> set, item;
+    bool negate = false;
+    int low, high;
+
+    if (m_pos < m_end && *m_pos == '^')
+    {
+        negate = true;
+        m_pos++;
+    }
+
+    // Leave empty classes to std::regex.
+    if (m_pos < m_end && *m_pos == ']')
+        return false;
+
+    for (;;)
+    {
+        if (m_pos == m_end)
+            return false;
+
+        if (*m_pos == ']')
+        {
+            m_pos++;
+            break;
+        }
+
+        if (!parse_class_atom(&item, &low))
+            return false;
+
+        // Parse a range.
+        if (m_end - m_pos >= 2 && m_pos[0] == '-' && m_pos[1] != ']')
+        {
+            m_pos++;
+
+            if (!parse_class_atom(&item, &high) || low < 0 || high < 0 || low > high)
+                return false;
+
+            for (; low <= high; low++)
+                set.set(low);
+        }
+        else
+        {
+            set |= item;
+        }
+    }
+
+    if (negate)
+        set.flip();
+
+    set_node(node, set);
+    return true;
+}
+
+/**
+ * PatternParser::parse_class_atom
+ *
+ * @description Parses a character or escape inside a bracket expression.
+ * @param[out] {set}  // The bytes it matches.
+ * @param[out] {byte} // The byte if it is a single one (otherwise -1).
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_class_atom(bitset<256>* set, int* byte)
+{
+    int i;
+
+    set->reset();
+    *byte = -1;
+
+    // Character class names, equivalence classes and collating elements.
+    if (*m_pos == '[' && m_end - m_pos >= 2 && strchr(":=.", m_pos[1]) != NULL)
+        return false;
+
+    if (*m_pos == '\\')
+    {
+        m_pos++;
+
+        if (!parse_escape(set, true))
+            return false;
+
+        if (set->count() == 1)
+        {
+            for (i = 0; !set->test(i); i++);
+            *byte = i;
+        }
+
+        return true;
+    }
+
+    *byte = (unsigned char)*m_pos++;
+    set->set(*byte);
+    return true;
+}
+
+/**
+ * PatternParser::parse_escape
+ *
+ * @description Parses an escape after the '\'.
+ * @param[out] {set}      // The bytes it matches.
+ * @param[in]  {in_class} // True inside a bracket expression.
+ * @returns // False if the syntax is not supported.
+ */
+bool PatternParser::parse_escape(bitset<256>* set, bool in_class)
+{
+    int c, i, value;
+
+    if (m_pos == m_end)
+        return false;
+
+    switch (c = (unsigned char)*m_pos++)
+    {
+    case 'd': case 'D':
+        for (i = '0'; i <= '9'; i++) set->set(i);
+        break;
+
+    case 'w': case 'W':
+        for (i = 0; i < 256; i++)
+            if (isalnum(i) || i == '_') set->set(i);
+        break;
+
+    case 's': case 'S':
+        for (i = 0; i < 256; i++)
+            if (isspace(i)) set->set(i);
+        break;
+
+    case 'n': set->set('\n'); return true;
+    case 'r': set->set('\r'); return true;
+    case 't': set->set('\t'); return true;
+    case 'f': set->set('\f'); return true;
+    case 'v': set->set('\v'); return true;
+
+    case '0':
+        // Octal and backreferences are not supported.
+        if (m_pos < m_end && isdigit((unsigned char)*m_pos))
+            return false;
+
+        set->set(0);
+        return true;
+
+    case 'x':
+        if (m_end - m_pos < 2 || !isxdigit((unsigned char)m_pos[0]) || !isxdigit((unsigned char)m_pos[1]))
+            return false;
+
+        sscanf(m_pos, "%2x", &value);
+        m_pos += 2;
+        set->set(value);
+        return true;
+
+    case 'b':
+        // A backspace in a class, otherwise a word boundary.
+        if (!in_class)
+            return false;
+
+        set->set('\b');
+        return true;
+
+    default:
+        if (isalnum(c))
+            return false;
+
+        set->set(c);
+        return true;
+    }
+
+    if (isupper(c))
+        set->flip();
+
+    return true;
+}
+
+/**
+ * PatternParser::parse_number
+ *
+ * @description Parses a repeat count.
+ * @param[out] {number} // The count.
+ * @returns // False if there is none or it is too large.
+ */
+bool PatternParser::parse_number(int* number)
+{
+    const char* start = m_pos;
+
+    for (*number = 0; m_pos < m_end && isdigit((unsigned char)*m_pos); m_pos++)
+    {
+        if ((*number = *number * 10 + (*m_pos - '0')) > SPP_PATTERN_MAX_REPEAT)
+            return false;
+    }
+
+    return m_pos > start;
+}
+
+/**
+ * PatternParser::set_node
+ *
+ * @description Makes a node that matches a set of bytes.
+ * @param[out] {node} // The node.
+ * @param[in]  {set}  // The bytes.
+ */
+void PatternParser::set_node(PatternNode* node, const bitset<256>& set)
+{
+    *node = PatternNode(PATTERN_NODE_SET);
+    node->set = (int)m_sets->size();
+    m_sets->push_back(set);
+}
+
+/**
+ * PatternSet Constructor
+ *
+ * @description Creates an empty set.
+ */
+PatternSet::PatternSet(void)
+    : m_nclasses(1),
+      m_start(0),
+      m_count(0),
+      m_dfa(false)
+{
+    memset(m_classes, 0, sizeof(m_classes));
+}
+
+/**
+ * PatternSet::add
+ *
+ * @description Appends an expression. The set must be compiled again
+ *              before it is matched.
+ * @param[in] {pattern} // The ECMAScript expression.
+ */
+void PatternSet::add(const char* pattern)
+{
+    size_t states, sets;
+    PatternNode root;
+    int start;
+
+    // Validate the expression the same way as before (throws regex_error).
+    regex expression(pattern);
+    PatternParser parser(pattern, &m_sets);
+
+    states = m_states.size();
+    sets = m_sets.size();
+
+    if (parser.parse(&root))
+    {
+        start = add_state(PATTERN_MATCH, -1, -1, m_count);
+
+        if ((start = build(root, start)) >= 0)
+        {
+            m_starts.push_back(start);
+            m_count++;
+            return;
+        }
+    }
+
+    // Fall back to std::regex for this expression.
+    m_states.resize(states);
+    m_sets.resize(sets);
+    m_fallback.push_back(make_pair(m_count++, expression));
+}
+
+/**
+ * PatternSet::compile
+ *
+ * @description Builds the DFA. Bytes that every expression treats alike
+ *              share a column of the transition table.
+ */
+void PatternSet::compile(void)
+{
+    map< vector<int>, int >::iterator it;
+    map< vector<int>, int > ids;
+    vector< vector<int> > dfa;
+    vector<char> seen(m_states.size(), 0);
+    vector<int> current, next;
+    unsigned char reps[256];
+    int remap[512];
+    size_t i, d;
+    int b, c;
+
+    // Split the bytes into classes by every set they belong to.
+    memset(m_classes, 0, sizeof(m_classes));
+    m_nclasses = 1;
+
+    for (i = 0; i < m_sets.size(); i++)
+    {
+        memset(remap, -1, sizeof(remap));
+
+        for (b = 0, m_nclasses = 0; b < 256; b++)
+        {
+            c = m_classes[b] * 2 + m_sets[i].test(b);
+
+            if (remap[c] < 0)
+                remap[c] = m_nclasses++;
+
+            m_classes[b] = (unsigned char)remap[c];
+        }
+    }
+
+    for (b = 255; b >= 0; b--)
+        reps[m_classes[b]] = (unsigned char)b;
+
+    // State 0 is the dead state.
+    m_table.clear();
+    m_accept.clear();
+    ids[current] = 0;
+    dfa.push_back(current);
+
+    current = m_starts;
+    closure(current, seen);
+    it = ids.insert(make_pair(current, (int)dfa.size())).first;
+
+    if (it->second == (int)dfa.size())
+        dfa.push_back(current);
+
+    m_start = it->second;
+
+    // Expand states breadth first.
+    for (d = 0; d < dfa.size(); d++)
+    {
+        current = dfa[d];
+        m_accept.push_back(get_accept(current));
+
+        for (c = 0; c < m_nclasses; c++)
+        {
+            next.clear();
+
+            for (i = 0; i < current.size(); i++)
+            {
+                const State& state = m_states[current[i]];
+
+                if (state.type == PATTERN_SET && m_sets[state.arg].test(reps[c]))
+                    next.push_back(state.out);
+            }
+
+            closure(next, seen);
+            it = ids.insert(make_pair(next, (int)dfa.size())).first;
+
+            if (it->second == (int)dfa.size())
+            {
+                // Too many states; simulate the automaton instead.
+                if (dfa.size() >= SPP_PATTERN_MAX_DFA)
+                {
+                    m_table.clear();
+                    m_accept.clear();
+                    m_dfa = false;
+                    return;
+                }
+
+                dfa.push_back(next);
+            }
+
+            m_table.push_back(it->second);
+        }
+    }
+
+    m_dfa = true;
+}
+
+/**
+ * PatternSet::match
+ *
+ * @description Finds the first expression that matches the whole input.
+ * @param[in] {data} // The input.
+ * @param[in] {size} // The input size.
+ * @returns // The index of the expression (-1 if none match).
+ */
+int PatternSet::match(const char* data, size_t size) const
+{
+    int state, first;
+    size_t i;
+
+    if (m_dfa)
+    {
+        for (i = 0, state = m_start; i < size && state != 0; i++)
+            state = m_table[state * m_nclasses + m_classes[(unsigned char)data[i]]];
+
+        first = m_accept[state];
+    }
+    else
+    {
+        first = simulate(data, size);
+    }
+
+    // Earlier expressions that the DFA could not hold still come first.
+    for (i = 0; i < m_fallback.size() && (first < 0 || m_fallback[i].first < first); i++)
+    {
+        if (regex_match(data, data + size, m_fallback[i].second))
+            return m_fallback[i].first;
+    }
+
+    return first;
+}
+
+/**
+ * PatternSet::add_state
+ *
+ * @description Appends an automaton state.
+ * @returns // The index of the state.
+ */
+int PatternSet::add_state(int type, int out, int out1, int arg)
+{
+    State state;
+
+    state.type = type;
+    state.out = out;
+    state.out1 = out1;
+    state.arg = arg;
+    m_states.push_back(state);
+
+    return (int)m_states.size() - 1;
+}
+
+/**
+ * PatternSet::build
+ *
+ * @description Builds the automaton for a node, back to front.
+ * @param[in] {node} // The syntax tree.
+ * @param[in] {next} // The state that follows the node.
+ * @returns // The first state of the node (-1 if it is too large).
+ */
+int PatternSet::build(const PatternNode& node, int next)
+{
+    int i, start, branch;
+
+    if (next < 0 || m_states.size() >= SPP_PATTERN_MAX_NFA)
+        return -1;
+
+    switch (node.type)
+    {
+    case PATTERN_NODE_SET:
+        return add_state(PATTERN_SET, next, -1, node.set);
+
+    case PATTERN_NODE_CAT:
+        for (i = (int)node.children.size() - 1; i >= 0; i--)
+            next = build(node.children[i], next);
+
+        return next;
+
+    case PATTERN_NODE_ALT:
+        start = build(node.children.back(), next);
+
+        for (i = (int)node.children.size() - 2; i >= 0 && start >= 0; i--)
+        {
+            if ((branch = build(node.children[i], next)) < 0)
+                return -1;
+
+            start = add_state(PATTERN_SPLIT, branch, start, 0);
+        }
+
+        return start;
+
+    default:
+        // Unbounded repeats loop back through a split.
+        if (node.max < 0)
+        {
+            branch = add_state(PATTERN_SPLIT, -1, next, 0);
+
+            if ((start = build(node.children[0], branch)) < 0)
+                return -1;
+
+            m_states[branch].out = start;
+            next = branch;
+        }
+
+        // Optional copies, then required copies.
+        for (i = node.min; i < node.max && next >= 0; i++)
+        {
+            if ((start = build(node.children[0], next)) < 0)
+                return -1;
+
+            next = add_state(PATTERN_SPLIT, start, next, 0);
+        }
+
+        for (i = 0; i < node.min; i++)
+            next = build(node.children[0], next);
+
+        return next;
+    }
+}
+
+/**
+ * PatternSet::closure
+ *
+ * @description Follows splits from a set of states.
+ * @param[in/out] {states} // The states, replaced by the sorted states
+ *                         // reachable from them that read or match.
+ * @param[in]     {seen}   // Scratch marks, one per state (left cleared).
+ */
+void PatternSet::closure(vector<int>& states, vector<char>& seen) const
+{
+    vector<int> stack, visited;
+    int s;
+
+    stack.swap(states);
+
+    while (!stack.empty())
+    {
+        s = stack.back();
+        stack.pop_back();
+
+        if (seen[s])
+            continue;
+
+        seen[s] = 1;
+        visited.push_back(s);
+
+        if (m_states[s].type == PATTERN_SPLIT)
+        {
+            stack.push_back(m_states[s].out1);
+            stack.push_back(m_states[s].out);
+        }
+        else
+        {
+            states.push_back(s);
+        }
+    }
+
+    for (size_t i = 0; i < visited.size(); i++)
+        seen[visited[i]] = 0;
+
+    sort(states.begin(), states.end());
+}
+
+/**
+ * PatternSet::get_accept
+ *
+ * @description Finds the first expression matched in a set of states.
+ * @param[in] {states} // The states.
+ * @returns // The index of the expression (-1 if none).
+ */
+int PatternSet::get_accept(const vector<int>& states) const
+{
+    int first = -1;
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        const State& state = m_states[states[i]];
+
+        if (state.type == PATTERN_MATCH && (first < 0 || state.arg < first))
+            first = state.arg;
+    }
+
+    return first;
+}
+
+/**
+ * PatternSet::simulate
+ *
+ * @description Runs the automaton without a DFA, one set of states per
+ *              input byte.
+ * @param[in] {data} // The input.
+ * @param[in] {size} // The input size.
+ * @returns // The index of the first expression matched (-1 if none).
+ */
+int PatternSet::simulate(const char* data, size_t size) const
+{
+    vector<char> seen(m_states.size(), 0);
+    vector<int> current(m_starts), next;
+    size_t i, j;
+
+    closure(current, seen);
+
+    for (i = 0; i < size && !current.empty(); i++)
+    {
+        next.clear();
+
+        for (j = 0; j < current.size(); j++)
+        {
+            const State& state = m_states[current[j]];
+
+            if (state.type == PATTERN_SET && m_sets[state.arg].test((unsigned char)data[i]))
+                next.push_back(state.out);
+        }
+
+        closure(next, seen);
+        current.swap(next);
+    }
+
+    return get_accept(current);
+}
\ No newline at end of file
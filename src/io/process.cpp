@@ -55,4 +55,255 @@ void Lock::release(void)
 #elif defined(SPP_LINUX)
     m_mtx.unlock();
 #endif
+}
+
+/**
+ * Condition Constructor
+ */
+Condition::Condition(void)
+{
+#if defined(SPP_WINDOWS)
+    InitializeConditionVariable(&m_cv);
+#endif
+}
+
+/**
+ * Condition::wait
+ *
+ * @description Releases the lock and blocks until signalled.
+ * @param[out] {lock} // The aquired lock.
+ */
+void Condition::wait(Lock* lock)
+{
+#if defined(SPP_WINDOWS)
+    SleepConditionVariableCS(&m_cv, &lock->m_mtx, INFINITE);
+#elif defined(SPP_LINUX)
+    m_cv.wait(lock->m_mtx);
+#endif
+}
+
+/**
+ * Condition::signal
+ *
+ * @description Wakes one waiting thread.
+ */
+void Condition::signal(void)
+{
+#if defined(SPP_WINDOWS)
+    WakeConditionVariable(&m_cv);
+#elif defined(SPP_LINUX)
+    m_cv.notify_one();
+#endif
+}
+
+/**
+ * Condition::broadcast
+ *
+ * @description Wakes all waiting threads.
+ */
+void Condition::broadcast(void)
+{
+#if defined(SPP_WINDOWS)
+    WakeAllConditionVariable(&m_cv);
+#elif defined(SPP_LINUX)
+    m_cv.notify_all();
+#endif
+}
+
+/**
+ * ThreadPool Constructor
+ *
+ * @param[in] {size}     // The number of threads.
+ * @param[in] {capacity} // The maximum number of queued tasks.
+ */
+ThreadPool::ThreadPool(unsigned int size, size_t capacity)
+    : m_size(size),
+      m_capacity(capacity),
+      m_stop(true)
+{
+}
+
+/**
+ * ThreadPool Destructor
+ */
+ThreadPool::~ThreadPool(void)
+{
+    stop();
+}
+
+/**
+ * ThreadPool::thread_main
+ *
+ * @description Thread callback to run a pool thread.
+ * @param {param} // The pool instance.
+ */
+#if defined(SPP_WINDOWS)
+unsigned int __stdcall ThreadPool::thread_main(void* param)
+{
+    ((ThreadPool*)param)->run();
+    return 0;
+}
+#elif defined(SPP_LINUX)
+void* ThreadPool::thread_main(void* param)
+{
+    ((ThreadPool*)param)->run();
+    return NULL;
+}
+#endif
+
+/**
+ * ThreadPool::start
+ *
+ * @description Starts the pool threads.
+ */
+void ThreadPool::start(void)
+{
+    unsigned int i;
+
+    m_mtx.aquire();
+
+    if (!m_stop)
+    {
+        m_mtx.release();
+        return;
+    }
+
+    m_stop = false;
+    m_mtx.release();
+
+    for (i = 0; i < m_size; i++)
+    {
+#if defined(SPP_WINDOWS)
+        m_threads.push_back((HANDLE)_beginthreadex(NULL, 0, &thread_main, this, 0, NULL));
+#elif defined(SPP_LINUX)
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, &thread_main, this) == 0)
+            m_threads.push_back(thread);
+#endif
+    }
+}
+
+/**
+ * ThreadPool::stop
+ *
+ * @description Runs the remaining tasks and joins the pool threads.
+ */
+void ThreadPool::stop(void)
+{
+    unsigned int i;
+
+    m_mtx.aquire();
+    m_stop = true;
+    m_cv.broadcast();
+    m_mtx.release();
+
+    for (i = 0; i < m_threads.size(); i++)
+    {
+#if defined(SPP_WINDOWS)
+        WaitForSingleObject(m_threads[i], INFINITE);
+        CloseHandle(m_threads[i]);
+#elif defined(SPP_LINUX)
+        pthread_join(m_threads[i], NULL);
+#endif
+    }
+
+    m_threads.clear();
+}
+
+/**
+ * ThreadPool::submit
+ *
+ * @description Queues a task.
+ * @param[out] {task} // The task to run.
+ * @returns // True if the task was queued; false if the queue is full.
+ */
+bool ThreadPool::submit(Task* task)
+{
+    m_mtx.aquire();
+
+    if (m_stop || m_threads.empty() || m_tasks.size() >= m_capacity)
+    {
+        m_mtx.release();
+        return false;
+    }
+
+    m_tasks.push_back(task);
+    m_cv.signal();
+    m_mtx.release();
+
+    return true;
+}
+
+/**
+ * ThreadPool::run
+ *
+ * @description Runs queued tasks until the pool is stopped and drained.
+ */
+void ThreadPool::run(void)
+{
+    Task* task;
+
+    while (true)
+    {
+        m_mtx.aquire();
+
+        while (m_tasks.empty() && !m_stop)
+            m_cv.wait(&m_mtx);
+
+        if (m_tasks.empty())
+        {
+            m_mtx.release();
+            return;
+        }
+
+        task = m_tasks.front();
+        m_tasks.pop_front();
+        m_mtx.release();
+
+        task->run();
+    }
+}
+
+/**
+ * get_ticks
+ *
+ * @description Returns a monotonic clock reading.
+ * @returns // The clock in milliseconds.
+ */
+unsigned long long spp::get_ticks(void)
+{
+#if defined(SPP_WINDOWS)
+    return GetTickCount64();
+#elif defined(SPP_LINUX)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * get_cpu_count
+ *
+ * @description Returns the number of online processors.
+ * @returns // The processor count (at least 1).
+ */
+unsigned int spp::get_cpu_count(void)
+{
+    long count;
+
+#if defined(SPP_WINDOWS)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    count = info.dwNumberOfProcessors;
+#elif defined(SPP_LINUX)
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    count = 1;
+#endif
+
+    return count > 0 ? (unsigned int)count : 1;
 }
\ No newline at end of file
@@ -0,0 +1,1318 @@
+/**
+ * Serverpp Reactor implementation
+ *
+ * Author: Mayank Sindwani
+ * Date: 2015-10-03
+ */
+
+#include <spp/reactor.h>
+#include <string.h>
+
+#if defined(SPP_LINUX)
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <poll.h>
+
+// io_uring user data tags. Polls carry a 31 bit generation and the
+// socket; operations carry their aligned data with the kind in the low
+// bits and the top bit set.
+#define SPP_URING_TAG_IGNORE  0ULL
+#define SPP_URING_TAG_TIMEOUT (~0ULL)
+#define SPP_URING_TAG_OP      (1ULL << 63)
+#define SPP_URING_TAG_KIND    7ULL
+
+// io_uring operation kinds.
+#define SPP_URING_ACCEPT 1
+#define SPP_URING_RECV   2
+#define SPP_URING_SEND   3
+#define SPP_URING_SPLICE 4
+
+// The provided buffer group.
+#define SPP_URING_GROUP 0
+#endif
+
+using namespace spp;
+using namespace std;
+
+/**
+ * default_reactor
+ *
+ * @description Returns the name of the preferred reactor for the platform.
+ * @returns // The reactor name.
+ */
+const char* spp::default_reactor(void)
+{
+#if defined(SPP_LINUX)
+    return SPP_IO_EPOLL;
+#else
+    return SPP_IO_SELECT;
+#endif
+}
+
+/**
+ * create_reactor
+ *
+ * @description Creates a reactor by backend name.
+ * @param[in] {name} // The backend name.
+ * @returns // The reactor (NULL if the backend is unknown or unavailable).
+ */
+Reactor* spp::create_reactor(const char* name)
+{
+    if (!strcmp(name, SPP_IO_SELECT))
+        return new SelectReactor();
+
+#if defined(SPP_LINUX)
+    if (!strcmp(name, SPP_IO_EPOLL))
+    {
+        EpollReactor* reactor;
+
+        if ((reactor = new EpollReactor())->is_open())
+            return reactor;
+
+        delete reactor;
+    }
+    else if (!strcmp(name, SPP_IO_URING))
+    {
+        UringReactor* reactor;
+
+        if ((reactor = new UringReactor())->is_open())
+            return reactor;
+
+        delete reactor;
+    }
+#endif
+
+    return NULL;
+}
+
+#if defined(SPP_LINUX)
+
+/**
+ * epoll_mask
+ *
+ * @description Converts reactor interest flags to an epoll mask.
+ * @param[in] {events} // The reactor events.
+ * @returns // The epoll mask.
+ */
+static unsigned int epoll_mask(int events)
+{
+    unsigned int mask;
+
+    mask = 0;
+
+    if (events & SPP_EVENT_READ)
+        mask |= EPOLLIN | EPOLLRDHUP;
+
+    if (events & SPP_EVENT_WRITE)
+        mask |= EPOLLOUT;
+
+    return mask;
+}
+
+/**
+ * EpollReactor constructor.
+ */
+EpollReactor::EpollReactor(void)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+}
+
+/**
+ * EpollReactor destructor.
+ */
+EpollReactor::~EpollReactor(void)
+{
+    if (m_epoll >= 0)
+        ::close(m_epoll);
+}
+
+/**
+ * EpollReactor::add
+ *
+ * @description Registers a socket with the epoll set.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool EpollReactor::add(SOCKET s, int events, void* data)
+{
+    struct epoll_event ev;
+
+    ev.events = epoll_mask(events);
+    ev.data.ptr = data;
+
+    return epoll_ctl(m_epoll, EPOLL_CTL_ADD, s, &ev) == 0;
+}
+
+/**
+ * EpollReactor::modify
+ *
+ * @description Updates the interest of a registered socket.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool EpollReactor::modify(SOCKET s, int events, void* data)
+{
+    struct epoll_event ev;
+
+    ev.events = epoll_mask(events);
+    ev.data.ptr = data;
+
+    return epoll_ctl(m_epoll, EPOLL_CTL_MOD, s, &ev) == 0;
+}
+
+/**
+ * EpollReactor::remove
+ *
+ * @description Unregisters a socket.
+ * @param[in] {s} // The socket.
+ */
+void EpollReactor::remove(SOCKET s)
+{
+    struct epoll_event ev;
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, s, &ev);
+}
+
+/**
+ * EpollReactor::wait
+ *
+ * @description Waits for socket activity.
+ * @param[out] {events}  // The ready events.
+ * @param[in]  {max}     // The capacity of events.
+ * @param[in]  {timeout} // The timeout in milliseconds.
+ * @returns // The number of ready events (SOCKET_ERROR on failure).
+ */
+int EpollReactor::wait(ReactorEvent* events, int max, int timeout)
+{
+    struct epoll_event ready[SPP_MAX_EVENTS];
+    unsigned int mask;
+    int i, count;
+
+    if (max > SPP_MAX_EVENTS)
+        max = SPP_MAX_EVENTS;
+
+    // An interrupted wait is reported as an empty one.
+    if ((count = epoll_wait(m_epoll, ready, max, timeout)) < 0)
+        return errno == EINTR ? 0 : SOCKET_ERROR;
+
+    for (i = 0; i < count; i++)
+    {
+        mask = ready[i].events;
+
+        events[i].data = ready[i].data.ptr;
+        events[i].events = 0;
+
+        if (mask & (EPOLLIN | EPOLLRDHUP))
+            events[i].events |= SPP_EVENT_READ;
+
+        if (mask & EPOLLOUT)
+            events[i].events |= SPP_EVENT_WRITE;
+
+        if (mask & (EPOLLERR | EPOLLHUP))
+            events[i].events |= SPP_EVENT_ERROR;
+    }
+
+    return count;
+}
+
+/**
+ * uring_mask
+ *
+ * @description Converts reactor interest flags to a poll mask.
+ * @param[in] {events} // The reactor events.
+ * @returns // The poll mask.
+ */
+static unsigned int uring_mask(int events)
+{
+    unsigned int mask;
+
+    mask = 0;
+
+    if (events & SPP_EVENT_READ)
+        mask |= POLLIN | POLLRDHUP;
+
+    if (events & SPP_EVENT_WRITE)
+        mask |= POLLOUT;
+
+    return mask;
+}
+
+/**
+ * uring_tag
+ *
+ * @description Builds the user data of an operation.
+ * @param[in] {data} // The data returned with the result (8 byte aligned).
+ * @param[in] {kind} // The operation kind.
+ * @returns // The user data.
+ */
+static unsigned long long uring_tag(void* data, int kind)
+{
+    return SPP_URING_TAG_OP | (unsigned long long)(uintptr_t)data | (unsigned long long)kind;
+}
+
+/**
+ * UringReactor constructor.
+ *
+ * @param[in] {entries} // The submission queue size.
+ */
+UringReactor::UringReactor(unsigned int entries)
+    : m_sq_ptr(MAP_FAILED),
+      m_cq_ptr(MAP_FAILED),
+      m_sqes((struct io_uring_sqe*)MAP_FAILED),
+      m_buf_ring((struct io_uring_buf_ring*)MAP_FAILED),
+      m_buf_tail(0),
+      m_buffers(NULL),
+      m_pending(0),
+      m_gen(0),
+      m_timeout(false),
+      m_accepting(false),
+      m_accept_delay(false),
+      m_listener(INVALID_SOCKET)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    unsigned int i;
+
+    memset(&params, 0, sizeof(params));
+    m_retry.tv_sec = 0;
+    m_retry.tv_nsec = SPP_URING_RETRY * 1000000LL;
+
+    if ((m_ring = (int)syscall(__NR_io_uring_setup, entries, &params)) < 0)
+        return;
+
+    m_entries = params.sq_entries;
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Newer kernels map both rings with a single mapping.
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+
+    if (m_sq_ptr == MAP_FAILED)
+        goto error;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else
+    {
+        m_cq_ptr = mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+
+        if (m_cq_ptr == MAP_FAILED)
+            goto error;
+    }
+
+    m_sqes = (struct io_uring_sqe*)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+
+    if (m_sqes == MAP_FAILED)
+        goto error;
+
+    // Resolve the ring offsets.
+    m_sq_head  = (unsigned int*)((char*)m_sq_ptr + params.sq_off.head);
+    m_sq_tail  = (unsigned int*)((char*)m_sq_ptr + params.sq_off.tail);
+    m_sq_mask  = (unsigned int*)((char*)m_sq_ptr + params.sq_off.ring_mask);
+    m_sq_array = (unsigned int*)((char*)m_sq_ptr + params.sq_off.array);
+    m_cq_head  = (unsigned int*)((char*)m_cq_ptr + params.cq_off.head);
+    m_cq_tail  = (unsigned int*)((char*)m_cq_ptr + params.cq_off.tail);
+    m_cq_mask  = (unsigned int*)((char*)m_cq_ptr + params.cq_off.ring_mask);
+    m_cqes     = (struct io_uring_cqe*)((char*)m_cq_ptr + params.cq_off.cqes);
+
+    // Register the ring of receive buffers. Kernels without provided
+    // buffer rings also lack multishot accept, so the backend is refused.
+    m_buf_ring = (struct io_uring_buf_ring*)mmap(NULL, SPP_URING_BUFFERS * sizeof(struct io_uring_buf),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (m_buf_ring == MAP_FAILED)
+        goto error;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long long)m_buf_ring;
+    reg.ring_entries = SPP_URING_BUFFERS;
+    reg.bgid = SPP_URING_GROUP;
+
+    if (syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        goto error;
+
+    m_buffers = new char[SPP_URING_BUFFERS * SPP_URING_BUFFER_SIZE];
+
+    for (i = 0; i < SPP_URING_BUFFERS; i++)
+        provide((unsigned short)i);
+
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+    return;
+
+error:
+    ::close(m_ring);
+    m_ring = -1;
+}
+
+/**
+ * UringReactor destructor.
+ */
+UringReactor::~UringReactor(void)
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+
+    if (m_ring >= 0)
+        ::close(m_ring);
+
+    if (m_buf_ring != MAP_FAILED)
+        munmap(m_buf_ring, SPP_URING_BUFFERS * sizeof(struct io_uring_buf));
+
+    delete[] m_buffers;
+}
+
+/**
+ * UringReactor::submit
+ *
+ * @description Submits the queued entries and optionally waits for completions.
+ * @param[in] {wait}  // The number of completions to wait for.
+ * @param[in] {flags} // The io_uring_enter flags.
+ * @returns // The number of entries submitted (SOCKET_ERROR on failure).
+ */
+int UringReactor::submit(unsigned int wait, unsigned int flags)
+{
+    int rtn;
+
+    rtn = (int)syscall(__NR_io_uring_enter, m_ring, m_pending, wait, flags, NULL, 0);
+
+    if (rtn >= 0)
+        m_pending -= rtn;
+
+    return rtn;
+}
+
+/**
+ * UringReactor::reserve
+ *
+ * @description Makes room for entries that must be submitted together,
+ * flushing the queue if it cannot take them.
+ * @param[in] {count} // The number of entries.
+ * @returns // True if there is room; false if the ring failed.
+ */
+bool UringReactor::reserve(unsigned int count)
+{
+    while (*m_sq_tail + count - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) > m_entries)
+    {
+        if (submit(0, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * UringReactor::get_sqe
+ *
+ * @description Reserves a submission queue entry, flushing the queue if full.
+ * @returns // The zeroed entry.
+ */
+struct io_uring_sqe* UringReactor::get_sqe(void)
+{
+    struct io_uring_sqe* sqe;
+    unsigned int tail, index;
+
+    if (!reserve(1))
+        return NULL;
+
+    tail = *m_sq_tail;
+    index = tail & *m_sq_mask;
+    sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    m_pending++;
+
+    return sqe;
+}
+
+/**
+ * UringReactor::next_gen
+ *
+ * @description Returns a new poll generation. Generations stay below the
+ * top bit of the user data, which marks operations.
+ * @returns // The generation.
+ */
+unsigned int UringReactor::next_gen(void)
+{
+    m_gen = m_gen % 0x7FFFFFFF + 1;
+    return m_gen;
+}
+
+/**
+ * UringReactor::provide
+ *
+ * @description Adds a receive buffer to the ring. The kernel sees it once
+ * the tail is published.
+ * @param[in] {id} // The buffer id.
+ */
+void UringReactor::provide(unsigned short id)
+{
+    struct io_uring_buf* buf;
+
+    // The ring is an array of buffers whose first entry overlays the tail.
+    // It is indexed directly, since C++ pads the flexible array member.
+    buf = (struct io_uring_buf*)m_buf_ring + (m_buf_tail & (SPP_URING_BUFFERS - 1));
+    buf->addr = (unsigned long long)(m_buffers + (size_t)id * SPP_URING_BUFFER_SIZE);
+    buf->len = SPP_URING_BUFFER_SIZE;
+    buf->bid = id;
+    m_buf_tail++;
+}
+
+/**
+ * UringReactor::arm
+ *
+ * @description Queues a one-shot poll for a registered socket. A poll that
+ * last completed without any requested event is delayed, since it would
+ * complete again at once.
+ * @param[in]  {s}   // The socket.
+ * @param[out] {reg} // The registration.
+ */
+void UringReactor::arm(SOCKET s, Registration* reg)
+{
+    struct io_uring_sqe* sqe;
+
+    if (reg->armed || reg->events == 0)
+        return;
+
+    // Start the poll when the linked timeout expires.
+    if (reg->delay && reserve(2) && (sqe = get_sqe()) != NULL)
+    {
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->addr = (unsigned long long)&m_retry;
+        sqe->len = 1;
+        sqe->timeout_flags = IORING_TIMEOUT_ETIME_SUCCESS;
+        sqe->user_data = SPP_URING_TAG_IGNORE;
+    }
+
+    if ((sqe = get_sqe()) == NULL)
+        return;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = s;
+    sqe->poll_events = uring_mask(reg->events);
+    sqe->user_data = ((unsigned long long)reg->gen << 32) | (unsigned int)s;
+    reg->armed = true;
+}
+
+/**
+ * UringReactor::arm_accept
+ *
+ * @description Queues a multishot accept on the listening socket. An
+ * accept that ended in an error is delayed, since the error may persist.
+ */
+void UringReactor::arm_accept(void)
+{
+    struct io_uring_sqe* sqe;
+
+    if (m_accepting || m_listener == INVALID_SOCKET)
+        return;
+
+    // Start accepting when the linked timeout expires.
+    if (m_accept_delay && reserve(2) && (sqe = get_sqe()) != NULL)
+    {
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->addr = (unsigned long long)&m_retry;
+        sqe->len = 1;
+        sqe->timeout_flags = IORING_TIMEOUT_ETIME_SUCCESS;
+        sqe->user_data = SPP_URING_TAG_IGNORE;
+    }
+
+    if ((sqe = get_sqe()) == NULL)
+        return;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = uring_tag(NULL, SPP_URING_ACCEPT);
+    m_accepting = true;
+    m_accept_delay = false;
+}
+
+/**
+ * UringReactor::disarm
+ *
+ * @description Cancels an outstanding poll. Its completion is discarded by
+ * bumping the registration generation.
+ * @param[in]  {s}   // The socket.
+ * @param[out] {reg} // The registration.
+ */
+void UringReactor::disarm(SOCKET s, Registration* reg)
+{
+    struct io_uring_sqe* sqe;
+
+    if (!reg->armed)
+        return;
+
+    if ((sqe = get_sqe()) != NULL)
+    {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = ((unsigned long long)reg->gen << 32) | (unsigned int)s;
+        sqe->user_data = SPP_URING_TAG_IGNORE;
+    }
+
+    reg->gen = next_gen();
+    reg->armed = false;
+}
+
+/**
+ * UringReactor::add
+ *
+ * @description Registers a socket. The poll is armed on the next wait.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool UringReactor::add(SOCKET s, int events, void* data)
+{
+    Registration reg;
+
+    reg.data = data;
+    reg.events = events;
+    reg.gen = next_gen();
+    reg.armed = false;
+    reg.delay = false;
+
+    if (!m_sockets.insert(make_pair(s, reg)).second)
+        return false;
+
+    m_arm.push_back(s);
+    return true;
+}
+
+/**
+ * UringReactor::modify
+ *
+ * @description Updates the interest of a registered socket.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool UringReactor::modify(SOCKET s, int events, void* data)
+{
+    map<SOCKET, Registration>::iterator it;
+
+    if ((it = m_sockets.find(s)) == m_sockets.end())
+        return false;
+
+    // Replace an outstanding poll with a different mask.
+    if (it->second.events != events)
+    {
+        disarm(s, &it->second);
+        it->second.delay = false;
+    }
+
+    it->second.data = data;
+    it->second.events = events;
+
+    if (!it->second.armed)
+        m_arm.push_back(s);
+
+    return true;
+}
+
+/**
+ * UringReactor::remove
+ *
+ * @description Unregisters a socket, or stops accepting on the listening
+ * socket.
+ * @param[in] {s} // The socket.
+ */
+void UringReactor::remove(SOCKET s)
+{
+    map<SOCKET, Registration>::iterator it;
+    struct io_uring_sqe* sqe;
+
+    if (s != INVALID_SOCKET && s == m_listener)
+    {
+        if (m_accepting && (sqe = get_sqe()) != NULL)
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = uring_tag(NULL, SPP_URING_ACCEPT);
+            sqe->user_data = SPP_URING_TAG_IGNORE;
+        }
+
+        m_listener = INVALID_SOCKET;
+        return;
+    }
+
+    if ((it = m_sockets.find(s)) == m_sockets.end())
+        return;
+
+    disarm(s, &it->second);
+    m_sockets.erase(it);
+}
+
+/**
+ * UringReactor::accept
+ *
+ * @description Accepts connections on a listening socket until it is
+ * removed. Each connection is returned as an accept event without data,
+ * whose result is the client socket (or the negated error).
+ * @param[in] {s} // The listening socket.
+ * @returns // True if successful; false otherwise.
+ */
+bool UringReactor::accept(SOCKET s)
+{
+    if (m_listener != INVALID_SOCKET)
+        return false;
+
+    m_listener = s;
+    m_accept_delay = false;
+    arm_accept();
+
+    return m_accepting;
+}
+
+/**
+ * UringReactor::recv
+ *
+ * @description Queues a receive into a provided buffer. Its event carries
+ * the buffer, which stays valid until the next wait.
+ * @param[in] {s}    // The socket.
+ * @param[in] {size} // The maximum number of bytes.
+ * @param[in] {data} // The data returned with the result.
+ * @returns // True if queued; false otherwise.
+ */
+bool UringReactor::recv(SOCKET s, size_t size, void* data)
+{
+    struct io_uring_sqe* sqe;
+
+    if ((sqe = get_sqe()) == NULL)
+        return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s;
+    sqe->len = (unsigned int)(size < SPP_URING_BUFFER_SIZE ? size : SPP_URING_BUFFER_SIZE);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SPP_URING_GROUP;
+    sqe->user_data = uring_tag(data, SPP_URING_RECV);
+    return true;
+}
+
+/**
+ * UringReactor::send
+ *
+ * @description Queues a gathered send. The message is read on submission
+ * and the memory it points to must outlive the operation.
+ * @param[in] {s}     // The socket.
+ * @param[in] {msg}   // The message.
+ * @param[in] {flags} // The send flags.
+ * @param[in] {data}  // The data returned with the result.
+ * @returns // True if queued; false otherwise.
+ */
+bool UringReactor::send(SOCKET s, struct msghdr* msg, int flags, void* data)
+{
+    struct io_uring_sqe* sqe;
+
+    if ((sqe = get_sqe()) == NULL)
+        return false;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = s;
+    sqe->addr = (unsigned long long)msg;
+    sqe->len = 1;
+    sqe->msg_flags = (unsigned int)flags;
+    sqe->user_data = uring_tag(data, SPP_URING_SEND);
+    return true;
+}
+
+/**
+ * UringReactor::splice
+ *
+ * @description Queues a file transfer through a pipe: the pipe is filled
+ * from the file, and once the socket is writable it is drained into the
+ * socket. The steps are hard linked so they run in order even when one
+ * falls short, and each moves what it can without blocking. Filling
+ * returns a splice event and draining a send event.
+ * @param[in] {file}   // The file.
+ * @param[in] {offset} // The file offset.
+ * @param[in] {size}   // The bytes to move into the pipe (0 to skip).
+ * @param[in] {pipe}   // The read and write ends of the pipe.
+ * @param[in] {s}      // The socket.
+ * @param[in] {length} // The bytes to move from the pipe to the socket.
+ * @param[in] {data}   // The data returned with the results.
+ * @returns // True if queued; false otherwise.
+ */
+bool UringReactor::splice(int file, off_t offset, size_t size, int* pipe, SOCKET s, size_t length, void* data)
+{
+    struct io_uring_sqe* sqe;
+
+    if (!reserve(size > 0 ? 3 : 2))
+        return false;
+
+    if (size > 0)
+    {
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        sqe->fd = pipe[1];
+        sqe->off = (unsigned long long)-1;
+        sqe->splice_fd_in = file;
+        sqe->splice_off_in = (unsigned long long)offset;
+        sqe->len = (unsigned int)size;
+        sqe->splice_flags = SPLICE_F_NONBLOCK;
+        sqe->user_data = uring_tag(data, SPP_URING_SPLICE);
+    }
+
+    sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->fd = s;
+    sqe->poll_events = POLLOUT;
+    sqe->user_data = SPP_URING_TAG_IGNORE;
+
+    sqe = get_sqe();
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = s;
+    sqe->off = (unsigned long long)-1;
+    sqe->splice_fd_in = pipe[0];
+    sqe->splice_off_in = (unsigned long long)-1;
+    sqe->len = (unsigned int)length;
+    sqe->splice_flags = SPLICE_F_NONBLOCK;
+    sqe->user_data = uring_tag(data, SPP_URING_SEND);
+    return true;
+}
+
+/**
+ * UringReactor::wait
+ *
+ * @description Submits the batched requests and waits for socket activity
+ * and completed operations.
+ * @param[out] {events}  // The ready events.
+ * @param[in]  {max}     // The capacity of events.
+ * @param[in]  {timeout} // The timeout in milliseconds.
+ * @returns // The number of ready events (SOCKET_ERROR on failure).
+ */
+int UringReactor::wait(ReactorEvent* events, int max, int timeout)
+{
+    static const int kinds[] = { 0, SPP_EVENT_ACCEPT, SPP_EVENT_RECV, SPP_EVENT_SEND, SPP_EVENT_SPLICE };
+
+    map<SOCKET, Registration>::iterator it;
+    struct io_uring_cqe* cqe;
+    struct io_uring_sqe* sqe;
+    unsigned int head, tail, gen, mask;
+    unsigned long long data;
+    unsigned short id;
+    size_t i;
+    int count, kind;
+    SOCKET s;
+
+    // Return the buffers handed out with the previous events.
+    for (i = 0; i < m_used.size(); i++)
+        provide(m_used[i]);
+
+    if (!m_used.empty())
+        __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+
+    m_used.clear();
+
+    // Re-arm sockets whose polls completed or changed.
+    for (i = 0; i < m_arm.size(); i++)
+    {
+        if ((it = m_sockets.find(m_arm[i])) != m_sockets.end())
+            arm(it->first, &it->second);
+    }
+
+    m_arm.clear();
+    arm_accept();
+
+    // Bound the wait; the timeout also completes on the first other event.
+    if (!m_timeout && (sqe = get_sqe()) != NULL)
+    {
+        m_ts.tv_sec = timeout / 1000;
+        m_ts.tv_nsec = (timeout % 1000) * 1000000LL;
+
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = (unsigned long long)&m_ts;
+        sqe->len = 1;
+        sqe->off = 1;
+        sqe->user_data = SPP_URING_TAG_TIMEOUT;
+        m_timeout = true;
+    }
+
+    // Submit the batch and wait in a single system call.
+    head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) &&
+        submit(1, IORING_ENTER_GETEVENTS) < 0)
+    {
+        return errno == EINTR ? 0 : SOCKET_ERROR;
+    }
+
+    count = 0;
+    tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail && count < max; head++)
+    {
+        cqe = &m_cqes[head & *m_cq_mask];
+        data = cqe->user_data;
+
+        if (data == SPP_URING_TAG_TIMEOUT)
+        {
+            m_timeout = false;
+            continue;
+        }
+
+        if (data == SPP_URING_TAG_IGNORE)
+            continue;
+
+        // Return the result of a completed operation.
+        if (data & SPP_URING_TAG_OP)
+        {
+            kind = (int)(data & SPP_URING_TAG_KIND);
+
+            if (kind == SPP_URING_ACCEPT)
+            {
+                // A multishot accept that ended is armed again on the next
+                // wait. The one cancelled by removing the listener is not.
+                if (!(cqe->flags & IORING_CQE_F_MORE))
+                {
+                    m_accepting = false;
+                    m_accept_delay = cqe->res < 0;
+                }
+
+                if (cqe->res < 0 && m_listener == INVALID_SOCKET)
+                    continue;
+            }
+
+            events[count].data = (void*)(uintptr_t)(data & ~(SPP_URING_TAG_OP | SPP_URING_TAG_KIND));
+            events[count].events = kinds[kind];
+            events[count].result = cqe->res;
+            events[count].buffer = NULL;
+
+            if (cqe->flags & IORING_CQE_F_BUFFER)
+            {
+                id = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                events[count].buffer = m_buffers + (size_t)id * SPP_URING_BUFFER_SIZE;
+                m_used.push_back(id);
+            }
+
+            count++;
+            continue;
+        }
+
+        s = (SOCKET)(data & 0xFFFFFFFF);
+        gen = (unsigned int)(data >> 32);
+
+        // Discard completions for cancelled or replaced polls.
+        if ((it = m_sockets.find(s)) == m_sockets.end() || it->second.gen != gen)
+            continue;
+
+        it->second.armed = false;
+        m_arm.push_back(s);
+
+        events[count].data = it->second.data;
+        events[count].events = 0;
+
+        if (cqe->res < 0)
+        {
+            events[count++].events = SPP_EVENT_ERROR;
+            continue;
+        }
+
+        // Poll reports a hang up of the peer's side even without read
+        // interest, which is not an event for a socket waiting to write.
+        mask = (unsigned int)cqe->res & (uring_mask(it->second.events) | POLLERR | POLLHUP);
+
+        if ((it->second.delay = mask == 0))
+            continue;
+
+        if (mask & (POLLIN | POLLRDHUP))
+            events[count].events |= SPP_EVENT_READ;
+
+        if (mask & POLLOUT)
+            events[count].events |= SPP_EVENT_WRITE;
+
+        if (mask & (POLLERR | POLLHUP))
+            events[count].events |= SPP_EVENT_ERROR;
+
+        count++;
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+    // Flush requests that could not be submitted while completions were pending.
+    if (m_pending > 0)
+        submit(0, 0);
+
+    return count;
+}
+
+#endif
+
+/**
+ * SelectReactor::add
+ *
+ * @description Registers a socket.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool SelectReactor::add(SOCKET s, int events, void* data)
+{
+    // Respect the fd_set limits.
+    if (m_sockets.size() >= FD_SETSIZE)
+        return false;
+
+    m_sockets[s] = make_pair(events, data);
+    return true;
+}
+
+/**
+ * SelectReactor::modify
+ *
+ * @description Updates the interest of a registered socket.
+ * @param[in] {s}      // The socket.
+ * @param[in] {events} // The events of interest.
+ * @param[in] {data}   // The data returned with events.
+ * @returns // True if successful; false otherwise.
+ */
+bool SelectReactor::modify(SOCKET s, int events, void* data)
+{
+    map< SOCKET, pair<int, void*> >::iterator it;
+
+    if ((it = m_sockets.find(s)) == m_sockets.end())
+        return false;
+
+    it->second = make_pair(events, data);
+    return true;
+}
+
+/**
+ * SelectReactor::remove
+ *
+ * @description Unregisters a socket.
+ * @param[in] {s} // The socket.
+ */
+void SelectReactor::remove(SOCKET s)
+{
+    m_sockets.erase(s);
+}
+
+/**
+ * SelectReactor::wait
+ *
+ * @description Waits for socket activity.
+ * @param[out] {events}  // The ready events.
+ * @param[in]  {max}     // The capacity of events.
+ * @param[in]  {timeout} // The timeout in milliseconds.
+ * @returns // The number of ready events (SOCKET_ERROR on failure).
+ */
+int SelectReactor::wait(ReactorEvent* events, int max, int timeout)
+{
+    map< SOCKET, pair<int, void*> >::iterator it;
+    fd_set fd_read, fd_write, fd_except;
+    struct timeval tv;
+    SOCKET nfds;
+    int count;
+
+    // Initialize the fd_sets.
+    FD_ZERO(&fd_read);
+    FD_ZERO(&fd_write);
+    FD_ZERO(&fd_except);
+    nfds = 0;
+
+    for (it = m_sockets.begin(); it != m_sockets.end(); it++)
+    {
+        if (it->second.first & SPP_EVENT_READ)
+            FD_SET(it->first, &fd_read);
+
+        if (it->second.first & SPP_EVENT_WRITE)
+            FD_SET(it->first, &fd_write);
+
+        FD_SET(it->first, &fd_except);
+
+        if (it->first >= nfds)
+            nfds = it->first + 1;
+    }
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    // Wait for socket activity.
+    if ((count = select((int)nfds, &fd_read, &fd_write, &fd_except, &tv)) <= 0)
+        return count;
+
+    count = 0;
+    for (it = m_sockets.begin(); it != m_sockets.end() && count < max; it++)
+    {
+        events[count].data = it->second.second;
+        events[count].events = 0;
+
+        if (FD_ISSET(it->first, &fd_read))
+            events[count].events |= SPP_EVENT_READ;
+
+        if (FD_ISSET(it->first, &fd_write))
+            events[count].events |= SPP_EVENT_WRITE;
+
+        if (FD_ISSET(it->first, &fd_except))
+            events[count].events |= SPP_EVENT_ERROR;
+
+        if (events[count].events != 0)
+            count++;
+    }
+
+    return count;
+}
+
+/**
+ * Notifier constructor.
+ */
+Notifier::Notifier(void)
+{
+#if defined(SPP_LINUX)
+    if ((m_socket = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        m_socket = INVALID_SOCKET;
+#else
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    u_long mode;
+
+    // Use a loopback datagram socket connected to itself.
+    addrlen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    mode = 1;
+
+    if ((m_socket = socket(AF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET)
+        return;
+
+    if (::bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(m_socket, (struct sockaddr*)&addr, &addrlen) == SOCKET_ERROR ||
+        connect(m_socket, (struct sockaddr*)&addr, addrlen) == SOCKET_ERROR ||
+        ioctlsocket(m_socket, FIONBIO, &mode) == SOCKET_ERROR)
+    {
+        closesocket(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+#endif
+}
+
+/**
+ * Notifier destructor.
+ */
+Notifier::~Notifier(void)
+{
+    if (m_socket != INVALID_SOCKET)
+        closesocket(m_socket);
+}
+
+/**
+ * Notifier::signal
+ *
+ * @description Makes the notifier readable.
+ */
+void Notifier::signal(void)
+{
+#if defined(SPP_LINUX)
+    unsigned long long value;
+
+    value = 1;
+    if (write(m_socket, &value, sizeof(value)) < 0) {}
+#else
+    ::send(m_socket, "", 1, 0);
+#endif
+}
+
+/**
+ * Notifier::clear
+ *
+ * @description Consumes pending signals.
+ */
+void Notifier::clear(void)
+{
+#if defined(SPP_LINUX)
+    unsigned long long value;
+
+    if (read(m_socket, &value, sizeof(value)) < 0) {}
+#else
+    char buffer[64];
+
+    while (::recv(m_socket, buffer, sizeof(buffer), 0) > 0);
+#endif
+}
+
+/**
+ * TimerWheel Constructor
+ *
+ * @description Creates an empty wheel.
+ * @param[in] {now} // The current time in milliseconds.
+ */
+TimerWheel::TimerWheel(unsigned long long now)
+    : m_tick(now / SPP_TIMER_RESOLUTION),
+      m_count(0)
+{
+    int level, slot;
+
+    // Each slot is a circular list around a sentinel.
+    for (level = 0; level < SPP_TIMER_LEVELS; level++)
+    {
+        for (slot = 0; slot < SPP_TIMER_SLOTS; slot++)
+            m_slots[level][slot].next = m_slots[level][slot].prev = &m_slots[level][slot];
+    }
+}
+
+/**
+ * TimerWheel::insert
+ *
+ * @description Links a timer into the slot for its distance from the
+ * current tick.
+ * @param[out] {timer} // The timer.
+ */
+void TimerWheel::insert(Timer* timer)
+{
+    unsigned long long delta;
+    Timer* head;
+    int level;
+
+    delta = timer->expires - m_tick;
+
+    // Find the first level whose span covers the timer.
+    for (level = 0; level < SPP_TIMER_LEVELS - 1; level++)
+    {
+        if (delta < (1ULL << (SPP_TIMER_BITS * (level + 1))))
+            break;
+    }
+
+    head = &m_slots[level][(timer->expires >> (SPP_TIMER_BITS * level)) & (SPP_TIMER_SLOTS - 1)];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/**
+ * TimerWheel::schedule
+ *
+ * @description Schedules or reschedules a timer.
+ * @param[out] {timer}    // The timer.
+ * @param[in]  {deadline} // The expiry time in milliseconds.
+ */
+void TimerWheel::schedule(Timer* timer, unsigned long long deadline)
+{
+    unsigned long long limit;
+
+    cancel(timer);
+
+    // Timers fire on the first tick at or after their deadline.
+    timer->expires = (deadline + SPP_TIMER_RESOLUTION - 1) / SPP_TIMER_RESOLUTION;
+    limit = m_tick + (1ULL << (SPP_TIMER_BITS * SPP_TIMER_LEVELS)) - 1;
+
+    if (timer->expires <= m_tick)
+        timer->expires = m_tick + 1;
+    else if (timer->expires > limit)
+        timer->expires = limit;
+
+    insert(timer);
+    m_count++;
+}
+
+/**
+ * TimerWheel::cancel
+ *
+ * @description Unlinks a timer if it is scheduled.
+ * @param[out] {timer} // The timer.
+ */
+void TimerWheel::cancel(Timer* timer)
+{
+    if (timer->prev == NULL)
+        return;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    m_count--;
+}
+
+/**
+ * TimerWheel::advance
+ *
+ * @description Moves the wheel to the current time and collects the
+ * timers that expired. Expired timers are unlinked.
+ * @param[in]  {now}     // The current time in milliseconds.
+ * @param[out] {expired} // The expired timers.
+ */
+void TimerWheel::advance(unsigned long long now, vector<Timer*>& expired)
+{
+    unsigned long long target;
+    Timer *head, *timer, *next;
+    int level;
+
+    target = now / SPP_TIMER_RESOLUTION;
+
+    while (m_tick < target)
+    {
+        // Nothing can expire on an empty wheel.
+        if (m_count == 0)
+        {
+            m_tick = target;
+            break;
+        }
+
+        m_tick++;
+
+        // Move timers down from every level that wrapped, highest first.
+        for (level = SPP_TIMER_LEVELS - 1; level > 0; level--)
+        {
+            if ((m_tick & ((1ULL << (SPP_TIMER_BITS * level)) - 1)) != 0)
+                continue;
+
+            head = &m_slots[level][(m_tick >> (SPP_TIMER_BITS * level)) & (SPP_TIMER_SLOTS - 1)];
+            timer = head->next;
+            head->next = head->prev = head;
+
+            for (; timer != head; timer = next)
+            {
+                next = timer->next;
+                insert(timer);
+            }
+        }
+
+        // Everything in the current slot is due.
+        head = &m_slots[0][m_tick & (SPP_TIMER_SLOTS - 1)];
+        timer = head->next;
+        head->next = head->prev = head;
+
+        for (; timer != head; timer = next)
+        {
+            next = timer->next;
+            timer->next = timer->prev = NULL;
+            expired.push_back(timer);
+            m_count--;
+        }
+    }
+}
\ No newline at end of file
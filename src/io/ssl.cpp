@@ -6,6 +6,11 @@
  */
 
 #include <spp/ssl.h>
+#include <string.h>
+#include <time.h>
+
+using namespace spp;
+using namespace std;
 
 /**
  * Initialize SSL
@@ -54,4 +59,385 @@ void spp::destroy_ssl(void)
 {
     ERR_free_strings();
     EVP_cleanup();
+}
+
+/**
+ * get_index
+ *
+ * @description Returns the SSL_CTX slot for a server object.
+ * @param[in] {kind} // 0 for the session cache, 1 for the ticket keys.
+ * @returns // The ex_data index.
+ */
+static int get_index(int kind)
+{
+    // Reserved while servers are configured, before workers start.
+    static int indices[2] = {
+        SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL),
+        SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL)
+    };
+
+    return indices[kind];
+}
+
+/**
+ * SSLSessionCache Constructor
+ *
+ * @description Creates an empty cache.
+ * @param[in] {size}    // The maximum number of sessions.
+ * @param[in] {timeout} // The session lifetime in seconds.
+ */
+SSLSessionCache::SSLSessionCache(size_t size, long timeout)
+    : m_capacity((size + SPP_SSL_CACHE_STRIPES - 1) / SPP_SSL_CACHE_STRIPES),
+      m_timeout(timeout) {}
+
+/**
+ * SSLSessionCache Destructor
+ *
+ * @description Releases the cached sessions.
+ */
+SSLSessionCache::~SSLSessionCache(void)
+{
+    Entries::iterator it;
+    int i;
+
+    for (i = 0; i < SPP_SSL_CACHE_STRIPES; i++)
+    {
+        for (it = m_stripes[i].entries.begin(); it != m_stripes[i].entries.end(); it++)
+            SSL_SESSION_free(it->second);
+    }
+}
+
+/**
+ * SSLSessionCache::attach
+ *
+ * @description Makes the cache the session store of a context.
+ * @param[out] {ctx} // The SSL context.
+ */
+void SSLSessionCache::attach(SSL_CTX* ctx)
+{
+    SSL_CTX_set_ex_data(ctx, get_index(0), this);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"serverpp", 8);
+    SSL_CTX_set_timeout(ctx, m_timeout);
+    SSL_CTX_sess_set_new_cb(ctx, &SSLSessionCache::new_session);
+    SSL_CTX_sess_set_get_cb(ctx, &SSLSessionCache::get_session);
+    SSL_CTX_sess_set_remove_cb(ctx, &SSLSessionCache::remove_session);
+}
+
+/**
+ * SSLSessionCache::get_stripe
+ *
+ * @description Picks the stripe for a session id. Ids are random, so their
+ * leading bytes spread sessions evenly.
+ * @param[in] {id} // The session id.
+ * @returns // The stripe.
+ */
+SSLSessionCache::Stripe* SSLSessionCache::get_stripe(const string& id)
+{
+    unsigned int hash;
+    size_t i;
+
+    hash = 0;
+
+    for (i = 0; i < id.size() && i < sizeof(hash); i++)
+        hash = (hash << 8) | (unsigned char)id[i];
+
+    return &m_stripes[hash % SPP_SSL_CACHE_STRIPES];
+}
+
+/**
+ * SSLSessionCache::add
+ *
+ * @description Stores a session, evicting the stripe's least recently
+ * used one when it is full. The cache takes the caller's reference.
+ * @param[out] {session} // The session.
+ * @returns // True if the session was stored; false otherwise.
+ */
+bool SSLSessionCache::add(SSL_SESSION* session)
+{
+    const unsigned char* data;
+    unsigned int length;
+    Stripe* stripe;
+    string id;
+
+    data = SSL_SESSION_get_id(session, &length);
+
+    if (length == 0 || m_capacity == 0)
+        return false;
+
+    id.assign((const char*)data, length);
+    stripe = get_stripe(id);
+    stripe->lock.aquire();
+
+    if (stripe->index.count(id) > 0)
+    {
+        stripe->lock.release();
+        return false;
+    }
+
+    // Evict the least recently used session.
+    if (stripe->entries.size() >= m_capacity)
+    {
+        SSL_SESSION_free(stripe->entries.back().second);
+        stripe->index.erase(stripe->entries.back().first);
+        stripe->entries.pop_back();
+    }
+
+    stripe->entries.push_front(make_pair(id, session));
+    stripe->index[id] = stripe->entries.begin();
+    stripe->lock.release();
+    return true;
+}
+
+/**
+ * SSLSessionCache::get
+ *
+ * @description Looks up a session for resumption.
+ * @param[in] {data}   // The session id.
+ * @param[in] {length} // The session id length.
+ * @returns // A new reference to the session (NULL if absent or expired).
+ */
+SSL_SESSION* SSLSessionCache::get(const unsigned char* data, int length)
+{
+    map<string, Entries::iterator>::iterator it;
+    SSL_SESSION* session;
+    Stripe* stripe;
+    string id;
+
+    id.assign((const char*)data, length);
+    stripe = get_stripe(id);
+    session = NULL;
+    stripe->lock.aquire();
+
+    if ((it = stripe->index.find(id)) != stripe->index.end())
+    {
+        session = it->second->second;
+
+        if ((long)time(NULL) - (long)SSL_SESSION_get_time(session) >= (long)SSL_SESSION_get_timeout(session))
+        {
+            // Drop the expired session.
+            SSL_SESSION_free(session);
+            stripe->entries.erase(it->second);
+            stripe->index.erase(it);
+            session = NULL;
+        }
+        else
+        {
+            // Mark the session as recently used.
+            stripe->entries.splice(stripe->entries.begin(), stripe->entries, it->second);
+            SSL_SESSION_up_ref(session);
+        }
+    }
+
+    stripe->lock.release();
+    return session;
+}
+
+/**
+ * SSLSessionCache::remove
+ *
+ * @description Forgets a session that OpenSSL invalidated.
+ * @param[out] {session} // The session.
+ */
+void SSLSessionCache::remove(SSL_SESSION* session)
+{
+    map<string, Entries::iterator>::iterator it;
+    const unsigned char* data;
+    unsigned int length;
+    Stripe* stripe;
+    string id;
+
+    data = SSL_SESSION_get_id(session, &length);
+    id.assign((const char*)data, length);
+    stripe = get_stripe(id);
+    stripe->lock.aquire();
+
+    if ((it = stripe->index.find(id)) != stripe->index.end())
+    {
+        SSL_SESSION_free(it->second->second);
+        stripe->entries.erase(it->second);
+        stripe->index.erase(it);
+    }
+
+    stripe->lock.release();
+}
+
+/**
+ * SSLSessionCache::new_session
+ *
+ * @description Stores a session created by a full handshake that can be
+ * resumed by id.
+ * @returns // 1 if the cache kept the reference; 0 otherwise.
+ */
+int SSLSessionCache::new_session(SSL* ssl, SSL_SESSION* session)
+{
+    SSLSessionCache* cache;
+
+    // TLS 1.3 sessions resume from stateless tickets and are never looked
+    // up by id, unless tickets are off and OpenSSL keys them by id.
+    if (SSL_version(ssl) == TLS1_3_VERSION && (SSL_get_options(ssl) & SSL_OP_NO_TICKET) == 0)
+        return 0;
+
+    cache = (SSLSessionCache*)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), get_index(0));
+    return cache->add(session) ? 1 : 0;
+}
+
+/**
+ * SSLSessionCache::get_session
+ *
+ * @description Resolves a session id offered by a client.
+ * @returns // The session (NULL to perform a full handshake).
+ */
+SSL_SESSION* SSLSessionCache::get_session(SSL* ssl, const unsigned char* data, int length, int* copy)
+{
+    SSLSessionCache* cache;
+
+    // The returned reference belongs to OpenSSL.
+    *copy = 0;
+    cache = (SSLSessionCache*)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), get_index(0));
+    return cache->get(data, length);
+}
+
+/**
+ * SSLSessionCache::remove_session
+ *
+ * @description Drops a session that OpenSSL invalidated.
+ */
+void SSLSessionCache::remove_session(SSL_CTX* ctx, SSL_SESSION* session)
+{
+    SSLSessionCache* cache;
+
+    if ((cache = (SSLSessionCache*)SSL_CTX_get_ex_data(ctx, get_index(0))) != NULL)
+        cache->remove(session);
+}
+
+/**
+ * SSLTicketKeys Constructor
+ *
+ * @description Generates the first ticket key.
+ * @param[in] {rotation} // The key lifetime in seconds.
+ */
+SSLTicketKeys::SSLTicketKeys(unsigned int rotation)
+    : m_rotation(rotation)
+{
+    rotate();
+    m_previous = m_current;
+}
+
+/**
+ * SSLTicketKeys::attach
+ *
+ * @description Makes the keys seal the session tickets of a context.
+ * @param[out] {ctx} // The SSL context.
+ */
+void SSLTicketKeys::attach(SSL_CTX* ctx)
+{
+    SSL_CTX_set_ex_data(ctx, get_index(1), this);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &SSLTicketKeys::ticket_key);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, &SSLTicketKeys::ticket_key);
+#endif
+}
+
+/**
+ * SSLTicketKeys::rotate
+ *
+ * @description Retires the current key and generates a new one.
+ */
+void SSLTicketKeys::rotate(void)
+{
+    m_previous = m_current;
+    RAND_bytes(m_current.name, sizeof(m_current.name));
+    RAND_bytes(m_current.aes, sizeof(m_current.aes));
+    RAND_bytes(m_current.hmac, sizeof(m_current.hmac));
+    m_rotated = get_ticks();
+}
+
+/**
+ * SSLTicketKeys::seal
+ *
+ * @description Sets up the cipher and MAC for a ticket.
+ * @param[out] {name} // The key name stored in the ticket.
+ * @param[out] {iv}   // The ticket IV.
+ * @param[out] {ctx}  // The cipher context.
+ * @param[out] {mac}  // The MAC context.
+ * @param[in]  {enc}  // Non-zero to issue a ticket; zero to open one.
+ * @returns // 1 to accept, 2 to accept and reissue, 0 for an unknown key
+ *          // or -1 on failure.
+ */
+int SSLTicketKeys::seal(unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* ctx, SPP_TICKET_MAC* mac, int enc)
+{
+    int result;
+    Key key;
+
+    m_lock.aquire();
+
+    if (get_ticks() - m_rotated >= m_rotation * 1000ULL)
+        rotate();
+
+    if (enc)
+    {
+        key = m_current;
+        result = 1;
+    }
+    else if (memcmp(name, m_current.name, sizeof(key.name)) == 0)
+    {
+        key = m_current;
+        result = 1;
+    }
+    else if (memcmp(name, m_previous.name, sizeof(key.name)) == 0)
+    {
+        key = m_previous;
+        result = 2;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    m_lock.release();
+
+    if (result == 0)
+        return 0;
+
+    if (enc)
+    {
+        memcpy(name, key.name, sizeof(key.name));
+
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+            return -1;
+    }
+
+    if (EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key.aes, iv, enc) != 1)
+        return -1;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[2];
+
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (EVP_MAC_init(mac, key.hmac, sizeof(key.hmac), params) != 1)
+        return -1;
+#else
+    if (HMAC_Init_ex(mac, key.hmac, sizeof(key.hmac), EVP_sha256(), NULL) != 1)
+        return -1;
+#endif
+
+    return result;
+}
+
+/**
+ * SSLTicketKeys::ticket_key
+ *
+ * @description Seals or opens a session ticket with the context's keys.
+ * @returns // See SSLTicketKeys::seal.
+ */
+int SSLTicketKeys::ticket_key(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* ctx, SPP_TICKET_MAC* mac, int enc)
+{
+    SSLTicketKeys* keys;
+
+    keys = (SSLTicketKeys*)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), get_index(1));
+    return keys->seal(name, iv, ctx, mac, enc);
 }
\ No newline at end of file
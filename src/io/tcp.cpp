@@ -6,23 +6,90 @@
  */
 
 #include <spp/tcp.h>
+#include <new>
 
 using namespace spp;
 using namespace std;
 
+/**
+ * Precompressed sidecar files in order of preference.
+ */
+static const struct
+{
+    int flag;
+    const char* name;
+    const char* suffix;
+}
+tcp_sidecars[] =
+{
+    { SPP_ENCODING_BR,   "br",   ".br" },
+    { SPP_ENCODING_GZIP, "gzip", ".gz" }
+};
+
+/**
+ * Types compressed on the fly unless a server lists its own.
+ */
+static const char* tcp_gzip_types[] =
+{
+    "text/html",
+    "text/css",
+    "text/plain",
+    "application/javascript",
+    "application/json",
+    "image/svg+xml"
+};
+
 /**
  * TCPListener
  *
- * @description Thread callback to run a server.
- * @param {param} // The server instance.
+ * @description Thread callback to run a server worker.
+ * @param {param} // The worker instance.
  */
+#if defined(SPP_WINDOWS)
 static unsigned int __stdcall tcp_listener(void* param)
 {
-    // Run the provided server instance.
-    TCPServer* server;
-    server = (TCPServer*)param;
-    return server->run();
+    // Run the provided worker instance.
+    TCPWorker* worker;
+    worker = (TCPWorker*)param;
+    return worker->server->run(worker);
+}
+#elif defined(SPP_LINUX)
+static void* tcp_listener(void* param)
+{
+    // Run the provided worker instance.
+    TCPWorker* worker;
+    worker = (TCPWorker*)param;
+    worker->server->run(worker);
+    return NULL;
 }
+#endif
+
+/**
+ * TCPResponseTask: Generates a client response on the thread pool and
+ * hands the client back to its worker.
+ */
+class TCPResponseTask : public Task
+{
+public:
+    // Constructor.
+    TCPResponseTask(TCPWorker* w, TCPClient* c)
+        : worker(w),
+          client(c) {}
+
+public:
+    // Member functions.
+    void run(void)
+    {
+        worker->server->serve(client);
+        worker->complete(client);
+        delete this;
+    }
+
+private:
+    // Data members.
+    TCPWorker* worker;
+    TCPClient* client;
+};
 
 /**
  * TCPClient::close
@@ -31,40 +98,200 @@ static unsigned int __stdcall tcp_listener(void* param)
  */
 void TCPClient::close(void)
 {
-    closesocket(socket);
-
-    // Shutdown SSL.
+    // Shutdown SSL. An unfinished handshake has no session to close.
     if (ssl)
     {
-        SSL_shutdown(ssl);
+        if (!handshaking)
+            SSL_shutdown(ssl);
+
         SSL_free(ssl);
     }
 
-    delete content;
+    closesocket(socket);
+
+#if defined(SPP_LINUX)
+    if (pipes[0] >= 0)
+    {
+        ::close(pipes[0]);
+        ::close(pipes[1]);
+    }
+#endif
+
+    if (source != NULL)
+        source->release();
+
+    if (cached != NULL)
+        cached->release();
+
+    delete[] content;
+    delete[] chunk;
+}
+
+/**
+ * TCPClient::reset
+ *
+ * @description Releases the sent response and drops the answered request
+ * from the receive buffer.
+ */
+void TCPClient::reset(void)
+{
+    output.clear();
+
+    if (source != NULL)
+        source->release();
+
+    if (cached != NULL)
+        cached->release();
+
+    delete[] content;
+    content = NULL;
+    source = NULL;
+    cached = NULL;
+    parts.clear();
+    part_headers.clear();
+    part = 0;
+    file = -1;
+    file_offset = 0;
+    file_remaining = 0;
+    chunk_size = 0;
+    chunk_offset = 0;
+
+    // Shift pipelined bytes to the front of the buffer.
+    memmove(headers, headers + request_size, header_size - request_size);
+    header_size -= request_size;
+    request_size = 0;
+    request.reset();
+}
+
+/**
+ * TCPClient::handshake
+ *
+ * @description Advances the TLS handshake without blocking.
+ * @returns // 0 when complete, the readiness events needed to continue or
+ *          // SOCKET_ERROR if the handshake failed.
+ */
+int TCPClient::handshake(void)
+{
+    int result;
+
+    if ((result = SSL_accept(ssl)) == 1)
+    {
+        handshaking = false;
+
+#if defined(SPP_KTLS)
+        // The kernel takes over encryption if it supports the cipher.
+        ktls = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+#endif
+        return 0;
+    }
+
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:  return SPP_EVENT_READ;
+    case SSL_ERROR_WANT_WRITE: return SPP_EVENT_WRITE;
+    }
+
+    return SOCKET_ERROR;
+}
+
+/**
+ * TCPClient::get_events
+ *
+ * @description Returns the readiness the client waits for: requests while
+ * it is still sending them and there is room to buffer them, and
+ * writability only while a response is in flight.
+ * @returns // The reactor events.
+ */
+int TCPClient::get_events(void)
+{
+    int events = 0;
+
+    if (is_reading())
+        events |= read_want;
+
+    if (is_sending())
+        events |= write_want;
+
+    return events;
+}
+
+/**
+ * TCPClient::ssl_error
+ *
+ * @description Classifies a failed SSL call. A call that waits for the
+ * socket records the readiness that resumes it and fails like a plain
+ * socket would block; any other failure ends the connection.
+ * @param[in]  {result} // The result of the SSL call.
+ * @param[out] {want}   // The readiness that resumes the call.
+ * @returns // SOCKET_ERROR.
+ */
+int TCPClient::ssl_error(int result, int& want)
+{
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+        want = SPP_EVENT_READ;
+        WSASetLastError(WSAEWOULDBLOCK);
+        break;
+
+    case SSL_ERROR_WANT_WRITE:
+        want = SPP_EVENT_WRITE;
+        WSASetLastError(WSAEWOULDBLOCK);
+        break;
+
+    default:
+        // errno may be stale, so don't let it pass for a full socket.
+        WSASetLastError(WSAECONNRESET);
+        break;
+    }
+
+    return SOCKET_ERROR;
 }
 
 /**
  * TCPClient::recv
  *
- * @description Recieves data.
+ * @description Recieves data. Decrypted bytes that SSL holds are read as
+ * well, since the socket will not signal them again.
  * @returns // The number of bytes read.
  */
 int TCPClient::recv(void)
 {
-    int read_bytes;
+    int read_bytes, total;
+
+    if (ssl == NULL)
+        return ::recv(socket, headers + header_size, SPP_MAX_HEADER_SIZE - header_size, 0);
+
+    total = 0;
+
+    do
+    {
+        read_bytes = SSL_read(ssl, headers + header_size + total, (int)(SPP_MAX_HEADER_SIZE - header_size - total));
+
+        if (read_bytes <= 0)
+        {
+            if (total > 0)
+                break;
+
+            // A closed session reads as the end of the stream.
+            if (SSL_get_error(ssl, read_bytes) == SSL_ERROR_ZERO_RETURN)
+                return 0;
 
-    // If ssl is enabled, call SSL_read. Otherwise, call recv.
-    read_bytes = ssl ?
-        SSL_read(ssl,  headers + header_size, SPP_MAX_HEADER_SIZE - header_size) :
-        ::recv(socket, headers + header_size, SPP_MAX_HEADER_SIZE - header_size, 0);
+            return ssl_error(read_bytes, read_want);
+        }
+
+        read_want = SPP_EVENT_READ;
+        total += read_bytes;
+    }
+    while (SSL_pending(ssl) > 0 && header_size + total < SPP_MAX_HEADER_SIZE);
 
-    return read_bytes;
+    return total;
 }
 
 /**
  * TCPClient::send
  *
- * @description Sends data.
+ * @description Sends the queued response.
  * @returns // The number of bytes sent.
  */
 int TCPClient::send(void)
@@ -72,585 +299,2542 @@ int TCPClient::send(void)
     int sent_bytes;
     sent_bytes = 0;
 
-    // Send the header.
-    if (header_size > 0)
+    // Queue the next part of a multipart body once the previous one is out.
+    if (output.empty() && file_remaining == 0 && part < parts.size())
+        next_part();
+
+    // Send the header and memory body. Hint that a file body follows.
+    if (!output.empty())
+    {
+        if (ssl == NULL)
+            sent_bytes = output.write(socket, file_remaining > 0 || part < parts.size() ? SPP_MORE_FLAGS : 0);
+        else if ((sent_bytes = output.write(ssl)) <= 0)
+            return ssl_error(sent_bytes, write_want);
+        else
+            write_want = SPP_EVENT_WRITE;
+
+        if (sent_bytes <= 0 || !output.empty())
+            return sent_bytes;
+    }
+
+    if (file_remaining == 0)
+        return sent_bytes;
+
+#if defined(SPP_LINUX)
+    // Stream the file from the page cache once the header is out.
+    if (ssl == NULL)
     {
-        sent_bytes = ssl ?
-            SSL_write(ssl, (char*)headers, header_size) :
-            ::send(socket, headers, header_size, 0);
+        sent_bytes = sendfile(socket, file, &file_offset, file_remaining);
 
-        header_size -= sent_bytes;
+        if (sent_bytes > 0)
+            file_remaining -= sent_bytes;
+        else if (sent_bytes == 0)
+            truncate();
+
+        return sent_bytes;
     }
+#endif
 
-    // Send the content.
-    if (content_size > 0)
+#if defined(SPP_KTLS)
+    // The kernel encrypts the file as it streams it.
+    if (ktls)
     {
-        sent_bytes = ssl ?
-            SSL_write(ssl, (char*)content, content_size) :
-            ::send(socket, content, content_size, 0);
+        sent_bytes = (int)SSL_sendfile(ssl, file, file_offset, file_remaining < SPP_KTLS_CHUNK ? file_remaining : SPP_KTLS_CHUNK, 0);
+
+        if (sent_bytes == 0)
+        {
+            truncate();
+            return 0;
+        }
+
+        if (sent_bytes < 0)
+            return ssl_error(sent_bytes, write_want);
 
-        content_size -= sent_bytes;
+        write_want = SPP_EVENT_WRITE;
+        file_offset += sent_bytes;
+        file_remaining -= sent_bytes;
+        return sent_bytes;
     }
+#endif
 
-    return sent_bytes;
+    return send_chunk();
 }
 
 /**
- * TCPServer constructor.
+ * TCPClient::next_part
  *
- * @param {server} // The server configuration.
+ * @description Queues the header and body of the next multipart part.
+ * The body is a range of the cached body or of the streamed file.
  */
-TCPServer::TCPServer(jToken* server)
-    : m_stop(true),
-      m_ssl_ctx(NULL)
+void TCPClient::next_part(void)
 {
-    HTTPLocation* http_location;
-    jToken *location_cert,
-           *location_key,
-           *location,
-           *ssl_token,
-           *temp;
+    TCPPart* next;
 
-    jArray *locations;
+    next = &parts[part++];
+    output.clear();
+    output.push(part_headers.data() + next->header, next->header_size);
 
-    string slog,
-           type,
-            key;
+    if (cached != NULL)
+    {
+        output.push(cached->get_data() + next->offset, next->size);
+    }
+    else
+    {
+        file_offset = next->offset;
+        file_remaining = next->size;
+    }
+}
 
-    char error_msg[80];
-    int i, rtn;
-    FILE* log;
+/**
+ * TCPClient::truncate
+ *
+ * @description Abandons a file body that ended early because the file
+ * shrank. The response cannot be completed, so the connection is closed
+ * once the bytes already queued are sent.
+ */
+void TCPClient::truncate(void)
+{
+    file_remaining = 0;
+    part = parts.size();
+    keep_alive = false;
+}
 
-    if (server->type != JCONF_OBJECT)
-        throw TCPException("Server must be an object.");
-    
-    // Get server port.
-    temp = jconf_get(server, "o", "port");
+/**
+ * TCPClient::send_chunk
+ *
+ * @description Copies the file body through a fixed-size chunk. The next
+ * chunk is read only after the previous one is written, so memory stays
+ * constant regardless of the file size.
+ * @returns // The number of bytes sent (SOCKET_ERROR if none were).
+ */
+int TCPClient::send_chunk(void)
+{
+    long read_bytes;
+    int sent_bytes;
 
-    if (temp == NULL || temp->type != JCONF_INT)
-        throw TCPException("An integer port is required.");
+    // Refill the chunk once the previous one is written.
+    if (chunk_offset == chunk_size)
+    {
+        if (chunk == NULL)
+            chunk = new char[SPP_CHUNK_SIZE];
 
-    m_port = strtol((char*)temp->data, NULL, 10);
+        read_bytes = read_file_at(
+            file,
+            chunk,
+            file_remaining < SPP_CHUNK_SIZE ? file_remaining : SPP_CHUNK_SIZE,
+            file_offset
+            );
 
-    // Get log path.
-    temp = jconf_get(server, "o", "traffic_log");
+        if (read_bytes <= 0)
+        {
+            truncate();
+            return 0;
+        }
 
-    if (temp != NULL)
+        file_offset += read_bytes;
+        chunk_size = (size_t)read_bytes;
+        chunk_offset = 0;
+    }
+
+    // A failed SSL_write must be retried with the same arguments.
+    if (ssl == NULL)
     {
-        if (temp->type != JCONF_STRING)
-            throw TCPException("Traffic log must be a string.");
+        if ((sent_bytes = ::send(socket, chunk + chunk_offset, (int)(chunk_size - chunk_offset), SPP_SEND_FLAGS)) <= 0)
+            return SOCKET_ERROR;
+    }
+    else
+    {
+        if ((sent_bytes = SSL_write(ssl, chunk + chunk_offset, (int)(chunk_size - chunk_offset))) <= 0)
+            return ssl_error(sent_bytes, write_want);
 
-        m_log = string((char*)temp->data);
+        write_want = SPP_EVENT_WRITE;
+    }
 
-#if defined(_MSC_VER)
-        fopen_s(&log, m_log.c_str(), "ab");
-#else
-        log = fopen(m_log.c_str(), "ab");
-#endif
+    chunk_offset += sent_bytes;
+    file_remaining -= sent_bytes;
+    return sent_bytes;
+}
 
-        if (log == NULL)
-            throw TCPException("Failed to open " + m_log);
+#if defined(SPP_LINUX)
 
-        fclose(log);
-    }
+/**
+ * TCPClient::queue_recv
+ *
+ * @description Queues a receive on the ring. The bytes land in a buffer
+ * of the ring rather than the request buffer, which is only written when
+ * the result is handled.
+ * @returns // True if queued; false otherwise.
+ */
+bool TCPClient::queue_recv(void)
+{
+    if (!ring->recv(socket, SPP_MAX_HEADER_SIZE - header_size, this))
+        return false;
 
-    // Set SSL context.
-    temp = jconf_get(server, "o", "ssl");
+    receiving = true;
+    ops++;
+    return true;
+}
 
-    if (temp != NULL)
+/**
+ * TCPClient::queue_send
+ *
+ * @description Queues the next send of the response on the ring. The
+ * header and memory body are sent with one gathered message, and a file
+ * body is spliced to the socket through the client's pipe.
+ * @returns // True if queued; false otherwise.
+ */
+bool TCPClient::queue_send(void)
+{
+    size_t size;
+    int flags;
+
+    // Queue the next part of a multipart body once the previous one is out.
+    if (output.empty() && file_remaining == 0 && part < parts.size())
+        next_part();
+
+    // Send the header and memory body. Hint that a file body follows.
+    if (!output.empty())
     {
-        // Get the SSL properties.
-        ssl_token = jconf_get(temp, "o", "enabled");
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = output.gather(vectors);
+        flags = SPP_SEND_FLAGS | (file_remaining > 0 || part < parts.size() ? SPP_MORE_FLAGS : 0);
+
+        if (!ring->send(socket, &message, flags, this))
+            return false;
+
+        splicing = false;
+        sending = true;
+        ops++;
+        return true;
+    }
 
-        if (ssl_token == NULL || ssl_token->type == JCONF_TRUE)
+    // Open the pipe for the first file body.
+    if (pipes[0] < 0)
+    {
+        if (pipe2(pipes, O_NONBLOCK | O_CLOEXEC) < 0)
         {
-            // Get the certificate.
-            location_cert = jconf_get(temp, "o", "cert");
+            pipes[0] = pipes[1] = -1;
+            return false;
+        }
 
-            if (location_cert == NULL || location_cert->type != JCONF_STRING)
-                throw TCPException("An SSL certificate path is required.");
+        if (fcntl(pipes[1], F_SETPIPE_SZ, SPP_PIPE_SIZE) < 0 || (pipe_size = (size_t)fcntl(pipes[1], F_GETPIPE_SZ)) == 0)
+            pipe_size = SPP_PIPE_SIZE;
+    }
 
-            m_cert = string((char*)location_cert->data);
+    // Fill the pipe with what it can take of the rest of the file.
+    size = file_remaining - piped;
 
-            // Get the key.
-            location_key = jconf_get(temp, "o", "key");
+    if (size > pipe_size - piped)
+        size = pipe_size - piped;
 
-            if (location_key == NULL || location_key->type != JCONF_STRING)
-                throw TCPException("An SSL key path is required.");
+    if (!ring->splice(file, file_offset, size, pipes, socket, file_remaining < pipe_size ? file_remaining : pipe_size, this))
+        return false;
 
-            m_ckey = string((char*)location_key->data);
+    // A pipe that was not filled counts as a full one.
+    spliced = -EAGAIN;
+    splicing = true;
+    sending = true;
+    ops += size > 0 ? 2 : 1;
+    return true;
+}
 
-            // Set the SSL context.
-            m_ssl_ctx = SSL_CTX_new(SSLv23_server_method());
-            SSL_CTX_set_options(m_ssl_ctx, SSL_OP_SINGLE_DH_USE);
+/**
+ * TCPClient::complete_recv
+ *
+ * @description Takes the result of a receive on the ring.
+ * @param[in] {result} // The operation result.
+ * @param[in] {buffer} // The buffer holding the bytes.
+ * @returns // The number of bytes read (SOCKET_ERROR on failure).
+ */
+int TCPClient::complete_recv(int result, const char* buffer)
+{
+    receiving = false;
 
-            if ((rtn = load_certificates(m_ssl_ctx, m_cert.c_str(), m_ckey.c_str())) < 0)
-                throw TCPException("Failed to load the SSL certificates.");
+    // Running out of buffers only delays the read until they are returned.
+    if (result < 0)
+    {
+        WSASetLastError(result == -ENOBUFS ? WSAEWOULDBLOCK : -result);
+        return SOCKET_ERROR;
+    }
+
+    memcpy(headers + header_size, buffer, result);
+    return result;
+}
+
+/**
+ * TCPClient::complete_send
+ *
+ * @description Takes the result of a send on the ring. A splice is only
+ * complete with the result of draining the pipe, which is preceded by the
+ * result of filling it. A file that ends early or cannot be read abandons
+ * the body.
+ * @param[in] {result} // The operation result.
+ * @returns // The number of bytes sent (SOCKET_ERROR on failure).
+ */
+int TCPClient::complete_send(int result)
+{
+    sending = false;
+
+    if (!splicing)
+    {
+        if (result < 0)
+        {
+            WSASetLastError(-result);
+            return SOCKET_ERROR;
         }
+
+        output.consume((size_t)result);
+        return result;
     }
 
-    // Set locations.
-    temp = jconf_get(server, "o", "locations");
+    if (spliced > 0)
+    {
+        file_offset += spliced;
+        piped += spliced;
+    }
 
-    if (temp == NULL || temp->type != JCONF_ARRAY)
-        throw TCPException("An array for locations is required.");
+    if (result > 0)
+    {
+        piped -= result;
+        file_remaining -= result;
+    }
 
-    locations = (jArray*)temp->data;
+    if (spliced != -EAGAIN && spliced <= 0)
+    {
+        truncate();
+        return result > 0 ? result : 0;
+    }
 
-    for (i = 0; i < locations->end; i++)
+    if (result < 0)
     {
-        // Get the type.
-        location = jconf_get(temp, "aa", i, 0);
-        sprintf(error_msg, "Invalid location at index %d", i);
+        WSASetLastError(result == -EAGAIN ? WSAEWOULDBLOCK : -result);
+        return SOCKET_ERROR;
+    }
 
-        if (location == NULL || location->type != JCONF_STRING)
-            throw TCPException(error_msg);
+    return result;
+}
 
-        type = string((char*)location->data);
+#endif
 
-        // Get the uri.
-        location = jconf_get(temp, "aa", i, 1);
+/**
+ * TCPBuffer::push
+ *
+ * @description Appends a segment to the queue.
+ * @param[out] {data} // The segment data.
+ * @param[in]  {size} // The segment size.
+ * @returns // True if the segment was queued; false if the queue is full.
+ */
+bool TCPBuffer::push(const char* data, size_t size)
+{
+    if (size == 0)
+        return true;
 
-        if (location == NULL || location->type != JCONF_STRING)
-            throw TCPException(error_msg);
+    if (m_count == SPP_MAX_SEGMENTS)
+        return false;
 
-        key = string((char*)location->data);
+    m_segments[m_count].data = data;
+    m_segments[m_count].size = size;
+    m_count++;
 
-        // Get the location object.
-        location = jconf_get(temp, "aa", i, 2);
+    return true;
+}
 
-        if (location == NULL)
-            throw TCPException(error_msg);
+/**
+ * TCPBuffer::consume
+ *
+ * @description Advances the queue past written bytes.
+ * @param[in] {size} // The number of bytes written.
+ */
+void TCPBuffer::consume(size_t size)
+{
+    Segment* segment;
 
-        try
-        {
+    while (size > 0 && m_index < m_count)
+    {
+        segment = &m_segments[m_index];
+
+        // Partially written segment.
+        if (size < segment->size)
+        {
+            segment->data += size;
+            segment->size -= size;
+            return;
+        }
+
+        size -= segment->size;
+        m_index++;
+    }
+
+    if (m_index == m_count)
+        clear();
+}
+
+/**
+ * TCPBuffer::clear
+ *
+ * @description Empties the queue.
+ */
+void TCPBuffer::clear(void)
+{
+    m_count = 0;
+    m_index = 0;
+}
+
+/**
+ * TCPBuffer::write
+ *
+ * @description Writes the queued segments with one gather call.
+ * @param[in] {s}     // The socket.
+ * @param[in] {flags} // Additional send flags.
+ * @returns // The number of bytes written (SOCKET_ERROR on failure).
+ */
+int TCPBuffer::write(SOCKET s, int flags)
+{
+#if defined(SPP_WINDOWS)
+    WSABUF buffers[SPP_MAX_SEGMENTS];
+    DWORD sent_bytes;
+    int i, count;
+
+    count = m_count - m_index;
+
+    for (i = 0; i < count; i++)
+    {
+        buffers[i].buf = (CHAR*)m_segments[m_index + i].data;
+        buffers[i].len = (ULONG)m_segments[m_index + i].size;
+    }
+
+    if (WSASend(s, buffers, count, &sent_bytes, flags, NULL, NULL) == SOCKET_ERROR)
+        return SOCKET_ERROR;
+#else
+    struct iovec buffers[SPP_MAX_SEGMENTS];
+    struct msghdr msg;
+    ssize_t sent_bytes;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = gather(buffers);
+
+    if ((sent_bytes = sendmsg(s, &msg, SPP_SEND_FLAGS | flags)) < 0)
+        return SOCKET_ERROR;
+#endif
+
+    consume((size_t)sent_bytes);
+    return (int)sent_bytes;
+}
+
+#if defined(SPP_LINUX)
+
+/**
+ * TCPBuffer::gather
+ *
+ * @description Describes the queued segments for a gather call.
+ * @param[out] {buffers} // The vectors (SPP_MAX_SEGMENTS entries).
+ * @returns // The number of vectors.
+ */
+int TCPBuffer::gather(struct iovec* buffers)
+{
+    int i;
+
+    for (i = 0; i < m_count - m_index; i++)
+    {
+        buffers[i].iov_base = (void*)m_segments[m_index + i].data;
+        buffers[i].iov_len = m_segments[m_index + i].size;
+    }
+
+    return i;
+}
+
+#endif
+
+/**
+ * TCPBuffer::write
+ *
+ * @description Writes the next segment as an SSL record.
+ * @param[out] {ssl} // The SSL connection.
+ * @returns // The number of bytes written (the SSL_write result on failure).
+ */
+int TCPBuffer::write(SSL* ssl)
+{
+    Segment* segment;
+    int sent_bytes;
+
+    segment = &m_segments[m_index];
+
+    // A failed SSL_write must be retried with the same arguments.
+    if ((sent_bytes = SSL_write(ssl, segment->data, (int)segment->size)) <= 0)
+        return sent_bytes;
+
+    consume((size_t)sent_bytes);
+    return sent_bytes;
+}
+
+/**
+ * TCPClient::prepare
+ *
+ * @description Queues a response. Bodies that fit behind the header are
+ * copied so the status line, headers and body leave in one segment.
+ * @param[in]  {length}  // The length of the header in the response buffer.
+ * @param[out] {body}    // The body (NULL if the body is a file).
+ * @param[in]  {size}    // The size of the body.
+ */
+void TCPClient::prepare(size_t length, const char* body, size_t size)
+{
+    output.clear();
+
+    if (body != NULL && size <= sizeof(response) - length)
+    {
+        memcpy(response + length, body, size);
+        output.push(response, length + size);
+        return;
+    }
+
+    output.push(response, length);
+
+    if (body != NULL)
+        output.push(body, size);
+}
+
+/**
+ * TCPSlab Constructor
+ *
+ * @description Preallocates the first chunk of client slots.
+ */
+TCPSlab::TCPSlab(void)
+    : m_size(0)
+{
+    grow();
+}
+
+/**
+ * TCPSlab Destructor
+ *
+ * @description Releases the chunks. Clients must already be freed.
+ */
+TCPSlab::~TCPSlab(void)
+{
+    size_t i;
+
+    for (i = 0; i < m_chunks.size(); i++)
+        ::operator delete(m_chunks[i]);
+}
+
+/**
+ * TCPSlab::grow
+ *
+ * @description Adds a chunk of free slots without moving existing clients.
+ * @returns // True if the slab grew; false if it is at its handle limit.
+ */
+bool TCPSlab::grow(void)
+{
+    size_t base, i;
+
+    base = m_generations.size();
+
+    if (base + SPP_SLAB_CHUNK > ((size_t)1 << SPP_SLAB_INDEX_BITS))
+        return false;
+
+    m_chunks.push_back((TCPClient*)::operator new(SPP_SLAB_CHUNK * sizeof(TCPClient)));
+    m_generations.resize(base + SPP_SLAB_CHUNK, 0);
+
+    // Hand out low slots first.
+    for (i = base + SPP_SLAB_CHUNK; i > base; i--)
+        m_free.push_back(i - 1);
+
+    return true;
+}
+
+/**
+ * TCPSlab::at
+ *
+ * @description Returns the client in a slot.
+ * @param[in] {index} // The slot index.
+ * @returns // The client (NULL if the slot is free).
+ */
+TCPClient* TCPSlab::at(size_t index)
+{
+    if (index >= m_generations.size() || !(m_generations[index] & 1))
+        return NULL;
+
+    return &m_chunks[index / SPP_SLAB_CHUNK][index % SPP_SLAB_CHUNK];
+}
+
+/**
+ * TCPSlab::get
+ *
+ * @description Resolves a handle from the reactor's user data. Handles are
+ * odd so they never collide with NULL or an aligned pointer.
+ * @param[out] {handle} // The client handle.
+ * @returns // The client (NULL if the handle is stale).
+ */
+TCPClient* TCPSlab::get(void* handle)
+{
+    uintptr_t value, index;
+
+    value = (uintptr_t)handle >> 1;
+    index = value & (((uintptr_t)1 << SPP_SLAB_INDEX_BITS) - 1);
+
+    if (index >= m_generations.size() ||
+        (value >> SPP_SLAB_INDEX_BITS) != (m_generations[index] & (UINTPTR_MAX >> (SPP_SLAB_INDEX_BITS + 1))))
+        return NULL;
+
+    return at(index);
+}
+
+/**
+ * TCPSlab::alloc
+ *
+ * @description Takes a free slot for a new client.
+ * @param[in] {s}    // The client socket.
+ * @param[in] {addr} // The client address.
+ * @param[in] {ssl}  // The SSL connection (NULL if plain).
+ * @returns // The client (NULL if the slab is full).
+ */
+TCPClient* TCPSlab::alloc(SOCKET s, sockaddr_in addr, SSL* ssl)
+{
+    TCPClient* client;
+    size_t index;
+
+    if (m_free.empty() && !grow())
+        return NULL;
+
+    index = m_free.back();
+    m_free.pop_back();
+    m_size++;
+
+    // An odd generation marks the slot as live.
+    m_generations[index]++;
+
+    client = new (&m_chunks[index / SPP_SLAB_CHUNK][index % SPP_SLAB_CHUNK]) TCPClient(s, addr, ssl);
+    client->handle = (void*)((((m_generations[index] << SPP_SLAB_INDEX_BITS) | index) << 1) | 1);
+    return client;
+}
+
+/**
+ * TCPSlab::free
+ *
+ * @description Returns a client's slot to the free list. Outstanding
+ * handles to it become stale.
+ * @param[out] {client} // The client.
+ */
+void TCPSlab::free(TCPClient* client)
+{
+    size_t index;
+
+    index = ((uintptr_t)client->handle >> 1) & (((uintptr_t)1 << SPP_SLAB_INDEX_BITS) - 1);
+
+    client->~TCPClient();
+    m_generations[index]++;
+    m_free.push_back(index);
+    m_size--;
+}
+
+/**
+ * TCPWorker::complete
+ *
+ * @description Queues a client whose response is ready and wakes the worker.
+ * @param[out] {client} // The client.
+ */
+void TCPWorker::complete(TCPClient* client)
+{
+    mtx_completed.aquire();
+    completed.push_back(client);
+    mtx_completed.release();
+
+    notifier.signal();
+}
+
+/**
+ * TCPServer constructor.
+ *
+ * @param {server} // The server configuration.
+ */
+TCPServer::TCPServer(jToken* server)
+    : m_cache(NULL),
+      m_files(NULL),
+#if defined(SPP_LINUX)
+      m_watcher(NULL),
+#endif
+      m_nworkers(get_cpu_count()),
+      m_keepalive_requests(SPP_KEEPALIVE_REQUESTS),
+      m_keepalive_timeout(SPP_KEEPALIVE_TIMEOUT),
+      m_header_timeout(SPP_HEADER_TIMEOUT),
+      m_write_timeout(SPP_WRITE_TIMEOUT),
+      m_pool(NULL),
+      m_stop(true),
+      m_gzip_min_size(SPP_GZIP_MIN_SIZE),
+      m_gzip_level(0),
+      m_ssl_cache(NULL),
+      m_ssl_tickets(NULL),
+      m_ktls(true),
+      m_ssl_ctx(NULL)
+{
+    HTTPLocation* http_location;
+    jToken *location_cert,
+           *location_key,
+           *location,
+           *ssl_token,
+           *pool_token,
+           *keepalive_token,
+           *timeout_token,
+           *cache_token,
+           *files_token,
+           *gzip_token,
+           *temp;
+
+    jArray *locations;
+
+    string slog,
+           type,
+            key;
+
+    char error_msg[80];
+    int i, rtn, pool_threads, pool_queue;
+    size_t j;
+    bool files_watch;
+    long session_size, session_timeout, ticket_rotation, cache_size, cache_max_file, files_size, files_ttl;
+    FILE* log;
+
+    if (server->type != JCONF_OBJECT)
+        throw TCPException("Server must be an object.");
+    
+    // Get server port.
+    temp = jconf_get(server, "o", "port");
+
+    if (temp == NULL || temp->type != JCONF_INT)
+        throw TCPException("An integer port is required.");
+
+    m_port = strtol((char*)temp->data, NULL, 10);
+
+    // Get the number of workers.
+    temp = jconf_get(server, "o", "workers");
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_INT || strtol((char*)temp->data, NULL, 10) <= 0)
+            throw TCPException("Workers must be a positive integer.");
+
+        m_nworkers = strtol((char*)temp->data, NULL, 10);
+    }
+
+#if !defined(SO_REUSEPORT)
+    // Without SO_REUSEPORT, the port can only have one listener.
+    m_nworkers = 1;
+#endif
+
+    // Get the thread pool properties.
+    temp = jconf_get(server, "o", "pool");
+    pool_threads = SPP_POOL_THREADS;
+    pool_queue = SPP_POOL_QUEUE;
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Pool must be an object.");
+
+        pool_token = jconf_get(temp, "o", "threads");
+
+        if (pool_token != NULL)
+        {
+            if (pool_token->type != JCONF_INT || (pool_threads = strtol((char*)pool_token->data, NULL, 10)) <= 0)
+                throw TCPException("Pool threads must be a positive integer.");
+        }
+
+        pool_token = jconf_get(temp, "o", "queue");
+
+        if (pool_token != NULL)
+        {
+            if (pool_token->type != JCONF_INT || (pool_queue = strtol((char*)pool_token->data, NULL, 10)) <= 0)
+                throw TCPException("Pool queue must be a positive integer.");
+        }
+    }
+
+    // Get log path.
+    temp = jconf_get(server, "o", "traffic_log");
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_STRING)
+            throw TCPException("Traffic log must be a string.");
+
+        m_log = string((char*)temp->data);
+
+#if defined(_MSC_VER)
+        fopen_s(&log, m_log.c_str(), "ab");
+#else
+        log = fopen(m_log.c_str(), "ab");
+#endif
+
+        if (log == NULL)
+            throw TCPException("Failed to open " + m_log);
+
+        fclose(log);
+    }
+
+    // Get the keep-alive properties.
+    temp = jconf_get(server, "o", "keepalive");
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Keepalive must be an object.");
+
+        keepalive_token = jconf_get(temp, "o", "requests");
+
+        if (keepalive_token != NULL)
+        {
+            if (keepalive_token->type != JCONF_INT || strtol((char*)keepalive_token->data, NULL, 10) < 0)
+                throw TCPException("Keepalive requests must be a non-negative integer.");
+
+            m_keepalive_requests = strtol((char*)keepalive_token->data, NULL, 10);
+        }
+
+        keepalive_token = jconf_get(temp, "o", "timeout");
+
+        if (keepalive_token != NULL)
+        {
+            if (keepalive_token->type != JCONF_INT || strtol((char*)keepalive_token->data, NULL, 10) < 0)
+                throw TCPException("Keepalive timeout must be a non-negative integer.");
+
+            m_keepalive_timeout = strtol((char*)keepalive_token->data, NULL, 10);
+        }
+    }
+
+    // Get the content cache properties.
+    temp = jconf_get(server, "o", "cache");
+    cache_size = SPP_CACHE_SIZE;
+    cache_max_file = SPP_CACHE_MAX_FILE;
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Cache must be an object.");
+
+        cache_token = jconf_get(temp, "o", "size");
+
+        if (cache_token != NULL)
+        {
+            if (cache_token->type != JCONF_INT || (cache_size = strtol((char*)cache_token->data, NULL, 10)) < 0)
+                throw TCPException("Cache size must be a non-negative integer.");
+        }
+
+        cache_token = jconf_get(temp, "o", "max_file");
+
+        if (cache_token != NULL)
+        {
+            if (cache_token->type != JCONF_INT || (cache_max_file = strtol((char*)cache_token->data, NULL, 10)) < 0)
+                throw TCPException("Cache max file must be a non-negative integer.");
+        }
+    }
+
+    // Get the open file cache properties.
+    temp = jconf_get(server, "o", "open_files");
+    files_size = SPP_FILE_CACHE_SIZE;
+    files_ttl = SPP_FILE_CACHE_TTL;
+    files_watch = true;
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Open files must be an object.");
+
+        files_token = jconf_get(temp, "o", "size");
+
+        if (files_token != NULL)
+        {
+            if (files_token->type != JCONF_INT || (files_size = strtol((char*)files_token->data, NULL, 10)) < 0)
+                throw TCPException("Open files size must be a non-negative integer.");
+        }
+
+        files_token = jconf_get(temp, "o", "ttl");
+
+        if (files_token != NULL)
+        {
+            if (files_token->type != JCONF_INT || (files_ttl = strtol((char*)files_token->data, NULL, 10)) < 0)
+                throw TCPException("Open files TTL must be a non-negative integer.");
+        }
+
+        files_token = jconf_get(temp, "o", "watch");
+
+        if (files_token != NULL)
+        {
+            if (files_token->type != JCONF_TRUE && files_token->type != JCONF_FALSE)
+                throw TCPException("Open files watch must be a boolean.");
+
+            files_watch = files_token->type == JCONF_TRUE;
+        }
+    }
+
+    // Get the on the fly compression properties. Compression is off unless
+    // configured.
+    temp = jconf_get(server, "o", "compression");
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Compression must be an object.");
+
+        m_gzip_level = SPP_GZIP_LEVEL;
+        gzip_token = jconf_get(temp, "o", "level");
+
+        if (gzip_token != NULL)
+        {
+            if (gzip_token->type != JCONF_INT || (m_gzip_level = strtol((char*)gzip_token->data, NULL, 10)) < 0 || m_gzip_level > 9)
+                throw TCPException("Compression level must be an integer from 0 to 9.");
+        }
+
+        gzip_token = jconf_get(temp, "o", "min_size");
+
+        if (gzip_token != NULL)
+        {
+            if (gzip_token->type != JCONF_INT || strtol((char*)gzip_token->data, NULL, 10) < 0)
+                throw TCPException("Compression min size must be a non-negative integer.");
+
+            m_gzip_min_size = strtol((char*)gzip_token->data, NULL, 10);
+        }
+
+        gzip_token = jconf_get(temp, "o", "types");
+
+        if (gzip_token != NULL)
+        {
+            if (gzip_token->type != JCONF_ARRAY)
+                throw TCPException("Compression types must be an array.");
+
+            for (j = 0; j < ((jArray*)gzip_token->data)->end; j++)
+            {
+                if ((temp = jconf_get(gzip_token, "a", (int)j)) == NULL || temp->type != JCONF_STRING)
+                    throw TCPException("Compression types must be strings.");
+
+                m_gzip_types.insert((char*)temp->data);
+            }
+        }
+        else
+        {
+            m_gzip_types.insert(tcp_gzip_types, tcp_gzip_types + sizeof(tcp_gzip_types) / sizeof(tcp_gzip_types[0]));
+        }
+    }
+
+    // Get the request and response deadlines.
+    temp = jconf_get(server, "o", "timeouts");
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_OBJECT)
+            throw TCPException("Timeouts must be an object.");
+
+        timeout_token = jconf_get(temp, "o", "header");
+
+        if (timeout_token != NULL)
+        {
+            if (timeout_token->type != JCONF_INT || strtol((char*)timeout_token->data, NULL, 10) <= 0)
+                throw TCPException("Header timeout must be a positive integer.");
+
+            m_header_timeout = strtol((char*)timeout_token->data, NULL, 10);
+        }
+
+        timeout_token = jconf_get(temp, "o", "write");
+
+        if (timeout_token != NULL)
+        {
+            if (timeout_token->type != JCONF_INT || strtol((char*)timeout_token->data, NULL, 10) <= 0)
+                throw TCPException("Write timeout must be a positive integer.");
+
+            m_write_timeout = strtol((char*)timeout_token->data, NULL, 10);
+        }
+    }
+
+    // Get the I/O backend.
+    temp = jconf_get(server, "o", "io");
+    m_io = default_reactor();
+
+    if (temp != NULL)
+    {
+        if (temp->type != JCONF_STRING)
+            throw TCPException("The I/O backend must be a string.");
+
+        m_io = string((char*)temp->data);
+
+        if (m_io != SPP_IO_SELECT && m_io != SPP_IO_EPOLL && m_io != SPP_IO_URING)
+            throw TCPException("Unknown I/O backend " + m_io);
+    }
+
+    // Set SSL context.
+    temp = jconf_get(server, "o", "ssl");
+
+    if (temp != NULL)
+    {
+        // Get the SSL properties.
+        ssl_token = jconf_get(temp, "o", "enabled");
+
+        if (ssl_token == NULL || ssl_token->type == JCONF_TRUE)
+        {
+            // Get the certificate.
+            location_cert = jconf_get(temp, "o", "cert");
+
+            if (location_cert == NULL || location_cert->type != JCONF_STRING)
+                throw TCPException("An SSL certificate path is required.");
+
+            m_cert = string((char*)location_cert->data);
+
+            // Get the key.
+            location_key = jconf_get(temp, "o", "key");
+
+            if (location_key == NULL || location_key->type != JCONF_STRING)
+                throw TCPException("An SSL key path is required.");
+
+            m_ckey = string((char*)location_key->data);
+
+            // Set the SSL context.
+            m_ssl_ctx = SSL_CTX_new(SSLv23_server_method());
+            SSL_CTX_set_options(m_ssl_ctx, SSL_OP_SINGLE_DH_USE);
+
+            if ((rtn = load_certificates(m_ssl_ctx, m_cert.c_str(), m_ckey.c_str())) < 0)
+                throw TCPException("Failed to load the SSL certificates.");
+
+            // Get the session resumption properties.
+            session_size = SPP_SSL_CACHE_SIZE;
+            session_timeout = SPP_SSL_SESSION_TIMEOUT;
+            ticket_rotation = SPP_SSL_TICKET_ROTATION;
+
+            if ((ssl_token = jconf_get(temp, "o", "session_cache")) != NULL)
+            {
+                if (ssl_token->type != JCONF_INT || (session_size = strtol((char*)ssl_token->data, NULL, 10)) < 0)
+                    throw TCPException("The SSL session cache must be a non-negative integer.");
+            }
+
+            if ((ssl_token = jconf_get(temp, "o", "session_timeout")) != NULL)
+            {
+                if (ssl_token->type != JCONF_INT || (session_timeout = strtol((char*)ssl_token->data, NULL, 10)) <= 0)
+                    throw TCPException("The SSL session timeout must be a positive integer.");
+            }
+
+            if ((ssl_token = jconf_get(temp, "o", "ticket_rotation")) != NULL)
+            {
+                if (ssl_token->type != JCONF_INT || (ticket_rotation = strtol((char*)ssl_token->data, NULL, 10)) < 0)
+                    throw TCPException("The SSL ticket rotation must be a non-negative integer.");
+            }
+
+            // Resume sessions from the shared cache.
+            if (session_size > 0)
+            {
+                m_ssl_cache = new SSLSessionCache(session_size, session_timeout);
+                m_ssl_cache->attach(m_ssl_ctx);
+            }
+            else
+            {
+                SSL_CTX_set_session_cache_mode(m_ssl_ctx, SSL_SESS_CACHE_OFF);
+            }
+
+            // Resume sessions from tickets sealed with rotating keys.
+            if (ticket_rotation > 0)
+            {
+                m_ssl_tickets = new SSLTicketKeys(ticket_rotation);
+                m_ssl_tickets->attach(m_ssl_ctx);
+                SSL_CTX_set_timeout(m_ssl_ctx, session_timeout);
+            }
+            else
+            {
+                SSL_CTX_set_options(m_ssl_ctx, SSL_OP_NO_TICKET);
+            }
+
+            // Offload record encryption to the kernel when it can.
+            if ((ssl_token = jconf_get(temp, "o", "ktls")) != NULL)
+            {
+                if (ssl_token->type != JCONF_TRUE && ssl_token->type != JCONF_FALSE)
+                    throw TCPException("kTLS must be a boolean.");
+
+                m_ktls = ssl_token->type == JCONF_TRUE;
+            }
+
+#if defined(SPP_KTLS)
+            if (m_ktls)
+                SSL_CTX_set_options(m_ssl_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+        }
+    }
+
+    // Set locations.
+    temp = jconf_get(server, "o", "locations");
+
+    if (temp == NULL || temp->type != JCONF_ARRAY)
+        throw TCPException("An array for locations is required.");
+
+    locations = (jArray*)temp->data;
+
+    for (i = 0; i < locations->end; i++)
+    {
+        // Get the type.
+        location = jconf_get(temp, "aa", i, 0);
+        sprintf(error_msg, "Invalid location at index %d", i);
+
+        if (location == NULL || location->type != JCONF_STRING)
+            throw TCPException(error_msg);
+
+        type = string((char*)location->data);
+
+        // Get the uri.
+        location = jconf_get(temp, "aa", i, 1);
+
+        if (location == NULL || location->type != JCONF_STRING)
+            throw TCPException(error_msg);
+
+        key = string((char*)location->data);
+
+        // Get the location object.
+        location = jconf_get(temp, "aa", i, 2);
+
+        if (location == NULL)
+            throw TCPException(error_msg);
+
+        try
+        {
             http_location = new HTTPLocation(location, server);
             m_locations.push_back(http_location);
             m_uri_map.set_location(type.c_str(), key.c_str(), http_location);
         }
-        catch (HTTPException)
+        catch (HTTPException)
+        {
+            throw TCPException(error_msg);
+        }
+    }
+
+    // Compile the location regexes.
+    m_uri_map.compile();
+
+    m_pool = new ThreadPool(pool_threads, pool_queue);
+
+    if (cache_size > 0)
+        m_cache = new ContentCache(cache_size, cache_max_file);
+
+    if (files_size > 0)
+        m_files = new FileCache(files_size, (unsigned long long)files_ttl * 1000);
+
+#if defined(SPP_LINUX)
+    // Cached files live until the watcher sees them change.
+    temp = jconf_get(server, "o", "root");
+
+    if (files_watch && temp != NULL && (m_files != NULL || m_cache != NULL))
+    {
+        m_watcher = new FileWatcher(m_files, m_cache);
+
+        if (m_watcher->watch((char*)temp->data))
+        {
+            if (m_files != NULL)
+                m_files->set_ttl(0);
+        }
+        else
+        {
+            TCPServerManager::get_manager()->log(
+                TCPServerManager::WARNING,
+                m_log.c_str(),
+                "Failed to watch %s; cached files expire after %ld seconds.",
+                (char*)temp->data,
+                files_ttl
+                );
+
+            delete m_watcher;
+            m_watcher = NULL;
+        }
+    }
+#endif
+}
+
+/**
+ * TCPServer destructor.
+ */
+TCPServer::~TCPServer(void)
+{
+    std::list< HTTPLocation* >::iterator it;
+
+    for (it = m_locations.begin(); it != m_locations.end(); it++)
+        delete *it;
+
+    free_workers();
+    delete m_pool;
+#if defined(SPP_LINUX)
+    delete m_watcher;
+#endif
+    delete m_cache;
+    delete m_files;
+
+    if (m_ssl_ctx)
+        SSL_CTX_free(m_ssl_ctx);
+
+    delete m_ssl_cache;
+    delete m_ssl_tickets;
+}
+
+/**
+ * TCPServer::create_listener
+ *
+ * @description Creates a listening socket bound to the server port.
+ * @returns // The listening socket.
+ */
+SOCKET TCPServer::create_listener(void)
+{
+    struct sockaddr_in addr;
+    char error_msg[80];
+    SOCKET slisten;
+    int err, opt;
+
+    // Create the listening socket.
+    if ((slisten = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+    {
+        err = WSAGetLastError();
+        throw TCPException("Failed to initialize the listening socket.", err);
+    }
+
+#if defined(SO_REUSEPORT)
+    // Let each worker bind its own socket; the kernel balances accepts.
+    opt = 1;
+    setsockopt(slisten, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt));
+#endif
+
+    // Bind to the loopback IP and provided port.
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(m_port);
+
+    // Bind the listening socket.
+    if (::bind(slisten, (struct sockaddr *) &addr, sizeof(addr)) == SOCKET_ERROR)
+    {
+        sprintf(error_msg, "Failed to bind the listening socket on port %d.", m_port);
+        err = WSAGetLastError();
+        closesocket(slisten);
+        throw TCPException(error_msg, err);
+    }
+
+    // Start listening.
+    if (listen(slisten, SOMAXCONN) == SOCKET_ERROR)
+    {
+        err = WSAGetLastError();
+        closesocket(slisten);
+        throw TCPException("Listen failed.", err);
+    }
+
+    return slisten;
+}
+
+/**
+ * TCPServer::start
+ *
+ * @description Starts the listening sockets and dispatches the worker threads.
+ */
+void TCPServer::start(void)
+{
+    TCPServerManager* manager;
+    TCPWorker* worker;
+    unsigned int i;
+    int err;
+    
+    if (is_running())
+        return;
+
+    manager = TCPServerManager::get_manager();
+    free_workers();
+
+    try
+    {
+        for (i = 0; i < m_nworkers; i++)
+        {
+            worker = new TCPWorker(this);
+            m_workers.push_back(worker);
+            worker->slisten = create_listener();
+
+            // Fall back to the platform reactor if the backend is unavailable.
+            if ((worker->reactor = create_reactor(m_io.c_str())) == NULL)
+            {
+                if (i == 0)
+                {
+                    manager->log(
+                        TCPServerManager::WARNING,
+                        m_log.c_str(),
+                        "The %s backend is unavailable; using %s.",
+                        m_io.c_str(),
+                        default_reactor()
+                        );
+                }
+
+                worker->reactor = create_reactor(default_reactor());
+            }
+#if defined(SPP_LINUX)
+            else if (m_io == SPP_IO_URING)
+            {
+                // The ring also accepts connections and serves plain clients.
+                worker->ring = (UringReactor*)worker->reactor;
+            }
+#endif
+
+            // Register the listening socket and the completion notifier with the reactor.
+            if (worker->reactor == NULL || !worker->notifier.is_open() ||
+#if defined(SPP_LINUX)
+                !(worker->ring != NULL ? worker->ring->accept(worker->slisten) : worker->reactor->add(worker->slisten, SPP_EVENT_READ, NULL)) ||
+#else
+                !worker->reactor->add(worker->slisten, SPP_EVENT_READ, NULL) ||
+#endif
+                !worker->reactor->add(worker->notifier.get_socket(), SPP_EVENT_READ, worker))
+            {
+                err = WSAGetLastError();
+                throw TCPException("Failed to initialize the reactor.", err);
+            }
+        }
+    }
+    catch (TCPException)
+    {
+        free_workers();
+        throw;
+    }
+
+    // Start the pool and worker threads.
+    m_pool->start();
+    m_stop.store(false, std::memory_order_release);
+
+#if defined(SPP_LINUX)
+    if (m_watcher != NULL)
+        m_watcher->start();
+#endif
+
+    for (i = 0; i < m_workers.size(); i++)
+    {
+#if defined(SPP_WINDOWS)
+        m_workers[i]->thread = (HANDLE)_beginthreadex(NULL, 0, &tcp_listener, m_workers[i], 0, NULL);
+#elif defined(SPP_LINUX)
+        pthread_create(&m_workers[i]->thread, NULL, &tcp_listener, m_workers[i]);
+#endif
+    }
+}
+
+/**
+ * TCPServer::free_workers
+ *
+ * @description Releases the sockets and reactors of stopped workers.
+ */
+void TCPServer::free_workers(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < m_workers.size(); i++)
+    {
+        if (m_workers[i]->slisten != INVALID_SOCKET)
+            closesocket(m_workers[i]->slisten);
+
+        delete m_workers[i]->reactor;
+        delete m_workers[i];
+    }
+
+    m_workers.clear();
+}
+
+/**
+ * TCPServer::is_running
+ *
+ * @description Returns a flag indicating if the server is running.
+ * @returns // True if it is running; false otherwise.
+ */
+bool TCPServer::is_running(void)
+{
+    return !m_stop.load(std::memory_order_acquire);
+}
+
+/**
+ * TCPServer::run
+ *
+ * @description: Accepts incomming connections and serves content.
+ * @param[out] {worker} // The worker to run.
+ * @returns // The termination status.
+ */
+int TCPServer::run(TCPWorker* worker)
+{
+    ReactorEvent events[SPP_MAX_EVENTS];
+    TCPServerManager* manager;
+    TCPClient* client;
+    int i, count, err;
+    size_t j;
+    socklen_t errlen;
+
+    manager = TCPServerManager::get_manager();
+    errlen = sizeof(err);
+    err = 0;
+
+    while (is_running())
+    {
+        // Wait for socket activity, waking each tick while timers are armed.
+        count = worker->reactor->wait(
+            events,
+            SPP_MAX_EVENTS,
+            worker->timers.empty() ? SPP_REACTOR_TICK : SPP_TIMER_RESOLUTION
+            );
+
+        if (count < 0)
+        {
+            if (!is_running())
+                break;
+
+            // The reactor failed.
+            err = manager->log(
+                TCPServerManager::ERR,
+                m_log.c_str(),
+                "Reactor wait failed. {%d}",
+                WSAGetLastError()
+                );
+
+            break;
+        }
+
+        for (i = 0; i < count; i++)
         {
-            throw TCPException(error_msg);
+            // The notifier is registered with the worker.
+            if (events[i].data == worker)
+            {
+                handle_completed(worker);
+                continue;
+            }
+
+#if defined(SPP_LINUX)
+            // Operations completed by the ring carry their results.
+            if (events[i].events & SPP_EVENT_RESULT)
+            {
+                handle_result(worker, &events[i]);
+                continue;
+            }
+#endif
+
+            // The listening socket is registered without a client.
+            if (events[i].data == NULL)
+            {
+                if (events[i].events & SPP_EVENT_ERROR)
+                {
+                    getsockopt(worker->slisten, SOL_SOCKET, SO_ERROR, (char*)&err, &errlen);
+                    err = manager->log(
+                        TCPServerManager::ERR,
+                        m_log.c_str(),
+                        "Listening socket error. {%d}",
+                        err
+                        );
+
+                    goto cleanup;
+                }
+
+                accept_client(worker);
+                continue;
+            }
+
+            // Skip events for clients closed earlier in the batch.
+            if ((client = worker->clients.get(events[i].data)) == NULL)
+                continue;
+
+            if (events[i].events & SPP_EVENT_ERROR)
+            {
+                close_client(worker, client);
+                continue;
+            }
+
+            // Reads and writes may close the client, so handle one per event.
+            // A TLS write that waits for readability goes first, since a read
+            // would take the records it waits for.
+            if (client->handshaking)
+                handle_handshake(worker, client);
+            else if (client->write_want == SPP_EVENT_READ && (events[i].events & SPP_EVENT_READ) && client->is_sending())
+                handle_write(worker, client);
+            else if ((events[i].events & client->read_want) && client->is_reading())
+                handle_read(worker, client);
+            else if ((events[i].events & client->write_want) && client->is_sending())
+                handle_write(worker, client);
+        }
+
+        handle_timeouts(worker);
+    }
+
+cleanup:
+    // Stop accepting connections.
+    worker->reactor->remove(worker->slisten);
+    closesocket(worker->slisten);
+    worker->slisten = INVALID_SOCKET;
+
+    // Wait for responses that are still being generated.
+    while (worker->pending > 0)
+    {
+        count = worker->reactor->wait(events, SPP_MAX_EVENTS, SPP_REACTOR_TICK);
+
+#if defined(SPP_LINUX)
+        for (i = 0; i < count; i++)
+        {
+            if (events[i].events & SPP_EVENT_RESULT)
+                handle_result(worker, &events[i]);
+        }
+#endif
+
+        handle_completed(worker);
+    }
+
+    // Close lingering clients.
+    for (j = 0; j < worker->clients.capacity(); j++)
+    {
+        if ((client = worker->clients.at(j)) != NULL)
+            close_client(worker, client);
+    }
+
+#if defined(SPP_LINUX)
+    // Clients with operations in flight are freed as they complete.
+    while (worker->clients.size() > 0)
+    {
+        if ((count = worker->reactor->wait(events, SPP_MAX_EVENTS, SPP_REACTOR_TICK)) < 0)
+            break;
+
+        for (i = 0; i < count; i++)
+        {
+            if (events[i].events & SPP_EVENT_RESULT)
+                handle_result(worker, &events[i]);
+        }
+    }
+#endif
+
+    return err;
+}
+
+/**
+ * TCPServer::accept_client
+ *
+ * @description Accepts a pending connection.
+ * @param[out] {worker} // The worker that owns the listening socket.
+ */
+void TCPServer::accept_client(TCPWorker* worker)
+{
+    TCPServerManager* manager;
+    socklen_t addrlen;
+    sockaddr_in addr;
+    SOCKET sclient;
+    u_long mode;
+
+    manager = TCPServerManager::get_manager();
+    addrlen = sizeof(addr);
+    mode = 1;
+
+    // Accept a connection.
+    if ((sclient = accept(worker->slisten, (sockaddr*)&addr, &addrlen)) == INVALID_SOCKET)
+    {
+        if (is_running())
+        {
+            manager->log(
+                TCPServerManager::ERR,
+                m_log.c_str(),
+                "Failed to accept a connection. {%d}",
+                WSAGetLastError()
+                );
+        }
+
+        return;
+    }
+
+    ioctlsocket(sclient, FIONBIO, &mode);
+    add_client(worker, sclient, addr);
+}
+
+/**
+ * TCPServer::add_client
+ *
+ * @description Adds an accepted non-blocking connection to the worker.
+ * Plain connections on the io_uring backend are served by completion;
+ * the others are registered with the reactor.
+ * @param[out] {worker}  // The worker that accepted the connection.
+ * @param[in]  {sclient} // The client socket.
+ * @param[in]  {addr}    // The client address.
+ */
+void TCPServer::add_client(TCPWorker* worker, SOCKET sclient, sockaddr_in addr)
+{
+    TCPClient* client;
+    SSL* ssl;
+
+    ssl = NULL;
+
+    // The handshake is driven by the reactor if SSL is enabled.
+    if (m_ssl_ctx != NULL)
+    {
+        if ((ssl = SSL_new(m_ssl_ctx)) == NULL || SSL_set_fd(ssl, sclient) != 1)
+        {
+            SSL_free(ssl);
+            closesocket(sclient);
+            return;
+        }
+
+        SSL_set_accept_state(ssl);
+    }
+
+    // Add to the collection of clients.
+    if ((client = worker->clients.alloc(sclient, addr, ssl)) == NULL)
+    {
+        SSL_free(ssl);
+        closesocket(sclient);
+        return;
+    }
+
+    client->timer.data = client;
+
+    // The handshake and first request must finish within the header timeout.
+    set_timeout(worker, client, m_header_timeout);
+
+#if defined(SPP_LINUX)
+    if (worker->ring != NULL && ssl == NULL)
+    {
+        client->ring = worker->ring;
+        update_events(worker, client);
+        return;
+    }
+#endif
+
+    if (!worker->reactor->add(sclient, SPP_EVENT_READ, client->handle))
+    {
+        close_client(worker, client);
+        return;
+    }
+
+    client->events = SPP_EVENT_READ;
+}
+
+/**
+ * TCPServer::handle_handshake
+ *
+ * @description Advances a client's TLS handshake and waits for the
+ * readiness it asks for.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The handshaking client.
+ */
+void TCPServer::handle_handshake(TCPWorker* worker, TCPClient* client)
+{
+    int events;
+
+    if ((events = client->handshake()) == SOCKET_ERROR)
+    {
+        // Don't serve a connection that failed the handshake.
+        close_client(worker, client);
+        return;
+    }
+
+    // Wait for the request once the handshake completes.
+    client->events = events == 0 ? SPP_EVENT_READ : events;
+    worker->reactor->modify(client->socket, client->events, client->handle);
+
+    // The request may have been decrypted along with the handshake.
+    if (events == 0 && SSL_pending(client->ssl) > 0)
+        handle_read(worker, client);
+}
+
+/**
+ * TCPServer::close_client
+ *
+ * @description Unregisters and closes a client.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The client to close.
+ */
+void TCPServer::close_client(TCPWorker* worker, TCPClient* client)
+{
+    worker->timers.cancel(&client->timer);
+
+#if defined(SPP_LINUX)
+    // Operations in flight still use the client, so it is freed when the
+    // last one completes. Shutting the socket down completes them.
+    if (client->ops > 0)
+    {
+        if (!client->closing)
+            shutdown(client->socket, SHUT_RDWR);
+
+        client->closing = true;
+        return;
+    }
+#endif
+
+    worker->reactor->remove(client->socket);
+    client->close();
+    worker->clients.free(client);
+}
+
+/**
+ * TCPServer::handle_read
+ *
+ * @description Receives request bytes from a readable client.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The readable client.
+ */
+void TCPServer::handle_read(TCPWorker* worker, TCPClient* client)
+{
+    // Recv bytes.
+    finish_read(worker, client, client->recv());
+}
+
+/**
+ * TCPServer::finish_read
+ *
+ * @description Handles the outcome of a read from a client.
+ * @param[out] {worker}     // The worker that owns the client.
+ * @param[out] {client}     // The client.
+ * @param[in]  {recv_bytes} // The number of bytes read (SOCKET_ERROR on failure).
+ */
+void TCPServer::finish_read(TCPWorker* worker, TCPClient* client, int recv_bytes)
+{
+    // Client closed the connection. A half-closed client still gets the
+    // response in flight and the requests it already sent.
+    if (recv_bytes == 0)
+    {
+        if (!client->is_sending())
+        {
+            close_client(worker, client);
+            return;
+        }
+
+        client->eof = true;
+        update_events(worker, client);
+        return;
+    }
+
+    if (recv_bytes == SOCKET_ERROR)
+    {
+        if (WSAGetLastError() != WSAEWOULDBLOCK)
+            close_client(worker, client);
+        else
+            update_events(worker, client);
+
+        return;
+    }
+
+    // A new request must finish its headers within the header timeout.
+    if (client->header_size == 0 && !client->is_sending())
+        set_timeout(worker, client, m_header_timeout);
+
+    // Increment the recieved bytes.
+    client->header_size += recv_bytes;
+
+    // Requests are answered in order, so wait for the response in flight.
+    if (!client->is_sending())
+        dispatch(worker, client);
+    else
+        update_events(worker, client);
+}
+
+/**
+ * TCPServer::dispatch
+ *
+ * @description Hands the next complete buffered request to the thread pool.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The idle client.
+ */
+void TCPServer::dispatch(TCPWorker* worker, TCPClient* client)
+{
+    TCPResponseTask* task;
+    SOCKET s;
+    int result;
+
+    s = client->socket;
+    result = client->request.parse(client->headers, client->header_size);
+
+    if (result == SPP_HTTP_PARSE_AGAIN)
+    {
+        // A half-closed client will never finish the request.
+        if (client->eof)
+        {
+            close_client(worker, client);
+            return;
+        }
+
+        // Wait for the rest of the request unless it cannot fit in the buffer.
+        if (client->header_size < SPP_MAX_HEADER_SIZE)
+        {
+            update_events(worker, client);
+            return;
+        }
+
+        result = SPP_HTTP_PARSE_ERROR;
+    }
+
+    if (result == SPP_HTTP_PARSE_ERROR)
+    {
+        // Reject the request and close once the response is sent.
+        client->request_size = client->header_size;
+        client->keep_alive = false;
+        generate_default(client, BAD_REQUEST, SPP_HTTP_400);
+        set_timeout(worker, client, m_write_timeout);
+        update_events(worker, client);
+        return;
+    }
+
+    // Generate the content off the event loop.
+    client->request_size = client->request.get_size();
+    client->pending = true;
+    task = new TCPResponseTask(worker, client);
+
+    if (m_pool->submit(task))
+    {
+        // The client is handed back through the completion queue.
+        worker->reactor->remove(s);
+        client->events = 0;
+        worker->timers.cancel(&client->timer);
+        worker->pending++;
+        return;
+    }
+
+    // The pool is saturated.
+    delete task;
+    client->pending = false;
+    client->keep_alive = false;
+    generate_default(client, SERVICE_UNAVAILABLE, SPP_HTTP_503);
+    set_timeout(worker, client, m_write_timeout);
+    update_events(worker, client);
+}
+
+/**
+ * TCPServer::handle_write
+ *
+ * @description Sends the response to a writable client.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The writable client.
+ */
+void TCPServer::handle_write(TCPWorker* worker, TCPClient* client)
+{
+    // Send bytes.
+    finish_write(worker, client, client->send());
+}
+
+/**
+ * TCPServer::finish_write
+ *
+ * @description Handles the outcome of a write to a client.
+ * @param[out] {worker}     // The worker that owns the client.
+ * @param[out] {client}     // The client.
+ * @param[in]  {send_bytes} // The number of bytes sent (SOCKET_ERROR on failure).
+ */
+void TCPServer::finish_write(TCPWorker* worker, TCPClient* client, int send_bytes)
+{
+    if (send_bytes == SOCKET_ERROR)
+    {
+        if (WSAGetLastError() != WSAEWOULDBLOCK)
+            close_client(worker, client);
+        else
+            update_events(worker, client);
+
+        return;
+    }
+
+    // Send complete.
+    if (!client->is_sending())
+    {
+        finish_response(worker, client);
+        return;
+    }
+
+    if (send_bytes > 0)
+        set_timeout(worker, client, m_write_timeout);
+
+    update_events(worker, client);
+}
+
+/**
+ * TCPServer::finish_response
+ *
+ * @description Closes or recycles a connection after its response is sent.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The client.
+ */
+void TCPServer::finish_response(TCPWorker* worker, TCPClient* client)
+{
+    if (!client->keep_alive || !is_running())
+    {
+        close_client(worker, client);
+        return;
+    }
+
+    // Drop the answered request and wait for the next one.
+    client->reset();
+    client->requests++;
+    update_events(worker, client);
+
+    // Idle connections are closed after the keep-alive timeout.
+    if (client->header_size == 0)
+        set_timeout(worker, client, m_keepalive_timeout);
+    else
+        set_timeout(worker, client, m_header_timeout);
+
+    // Answer a pipelined request that is already buffered. SSL may hold
+    // more of it than the full buffer could take, and the socket will not
+    // signal those bytes again.
+    if (client->ssl != NULL && SSL_pending(client->ssl) > 0 && client->is_reading())
+        handle_read(worker, client);
+    else
+        dispatch(worker, client);
+}
+
+/**
+ * TCPServer::set_timeout
+ *
+ * @description Replaces a client's deadline.
+ * @param[out] {worker}  // The worker that owns the client.
+ * @param[out] {client}  // The client.
+ * @param[in]  {seconds} // The time allowed from now.
+ */
+void TCPServer::set_timeout(TCPWorker* worker, TCPClient* client, unsigned int seconds)
+{
+    worker->timers.schedule(&client->timer, get_ticks() + seconds * 1000ULL);
+}
+
+/**
+ * TCPServer::update_events
+ *
+ * @description Updates the readiness a client is registered for.
+ * @param[out] {worker} // The worker that owns the client.
+ * @param[out] {client} // The client.
+ */
+void TCPServer::update_events(TCPWorker* worker, TCPClient* client)
+{
+    int events;
+
+#if defined(SPP_LINUX)
+    // Clients on the ring queue the operations they wait for instead. One
+    // that cannot be queued is closed on the next tick.
+    if (client->ring != NULL)
+    {
+        events = client->get_events();
+
+        if (((events & SPP_EVENT_READ) && !client->receiving && !client->queue_recv()) ||
+            ((events & SPP_EVENT_WRITE) && !client->sending && !client->queue_send()))
+        {
+            set_timeout(worker, client, 0);
         }
+
+        return;
     }
+#endif
+
+    if ((events = client->get_events()) != client->events)
+    {
+        worker->reactor->modify(client->socket, events, client->handle);
+        client->events = events;
+    }
+}
+
+/**
+ * TCPServer::handle_timeouts
+ *
+ * @description Closes clients that missed their header, idle or write
+ * deadline.
+ * @param[out] {worker} // The worker that owns the clients.
+ */
+void TCPServer::handle_timeouts(TCPWorker* worker)
+{
+    vector<Timer*> expired;
+    unsigned int i;
+
+    worker->timers.advance(get_ticks(), expired);
+
+    for (i = 0; i < expired.size(); i++)
+        close_client(worker, (TCPClient*)expired[i]->data);
 }
 
 /**
- * TCPServer destructor.
+ * TCPServer::handle_completed
+ *
+ * @description Registers clients whose responses were generated by the pool.
+ * @param[out] {worker} // The worker that owns the clients.
  */
-TCPServer::~TCPServer(void)
+void TCPServer::handle_completed(TCPWorker* worker)
 {
-    std::list< HTTPLocation* >::iterator it;
+    vector<TCPClient*> completed;
+    TCPClient* client;
+    unsigned int i;
 
-    for (it = m_locations.begin(); it != m_locations.end(); it++)
-        delete *it;
+    worker->notifier.clear();
 
-    if (m_ssl_ctx)
-        SSL_CTX_free(m_ssl_ctx);
+    // Take the completed clients.
+    worker->mtx_completed.aquire();
+    completed.swap(worker->completed);
+    worker->mtx_completed.release();
+
+    for (i = 0; i < completed.size(); i++)
+    {
+        client = completed[i];
+        client->pending = false;
+        worker->pending--;
+
+        // Lingering clients are closed by the worker during shutdown.
+        if (!is_running())
+            continue;
+
+        // The response must keep making progress.
+        set_timeout(worker, client, m_write_timeout);
+
+#if defined(SPP_LINUX)
+        if (client->ring != NULL)
+        {
+            update_events(worker, client);
+            continue;
+        }
+#endif
+
+        // Keep reading pipelined requests while the response is written.
+        client->events = client->get_events();
+
+        if (!worker->reactor->add(client->socket, client->events, client->handle))
+            close_client(worker, client);
+    }
 }
 
+#if defined(SPP_LINUX)
+
 /**
- * TCPServer::start
+ * TCPServer::handle_result
  *
- * @description Starts the listening socket and dispatches the worker thread.
+ * @description Handles an operation completed by the ring: an accepted
+ * connection, or a receive or send of a client.
+ * @param[out] {worker} // The worker that owns the ring.
+ * @param[in]  {event}  // The completion.
  */
-void TCPServer::start(void)
+void TCPServer::handle_result(TCPWorker* worker, ReactorEvent* event)
 {
-    struct sockaddr_in addr;
-    char error_msg[80];
-    int err;
-    
-    if (is_running())
+    TCPServerManager* manager;
+    TCPClient* client;
+    socklen_t addrlen;
+    sockaddr_in addr;
+    int bytes;
+
+    if (event->events & SPP_EVENT_ACCEPT)
+    {
+        if (event->result < 0)
+        {
+            if (is_running())
+            {
+                manager = TCPServerManager::get_manager();
+                manager->log(
+                    TCPServerManager::ERR,
+                    m_log.c_str(),
+                    "Failed to accept a connection. {%d}",
+                    -event->result
+                    );
+            }
+
+            return;
+        }
+
+        // Connections accepted while stopping are dropped.
+        if (!is_running())
+        {
+            closesocket(event->result);
+            return;
+        }
+
+        addrlen = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        getpeername(event->result, (sockaddr*)&addr, &addrlen);
+        add_client(worker, event->result, addr);
         return;
+    }
 
-    // Create the listening socket.
-    if ((m_slisten = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+    // The client stays allocated while it has operations in flight.
+    client = (TCPClient*)event->data;
+    client->ops--;
+    bytes = 0;
+
+    if (event->events & SPP_EVENT_RECV)
+        bytes = client->complete_recv(event->result, event->buffer);
+    else if (event->events & SPP_EVENT_SEND)
+        bytes = client->complete_send(event->result);
+    else
+        client->spliced = event->result;
+
+    if (client->closing)
     {
-#if defined(SPP_WINDOWS)
-        err = WSAGetLastError();
-#elif defined(SPP_LINUX)
-        // TODO
-#endif
-        throw TCPException("Failed to initialize the listening socket.", err);
+        if (client->ops == 0)
+            close_client(worker, client);
+
+        return;
     }
 
-    // Bind to the loopback IP and provided port.
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(m_port);
+    // Filling the pipe is accounted for once it is drained.
+    if (event->events & SPP_EVENT_SPLICE)
+        return;
 
-    // Bind the listening socket.
-    if (::bind(m_slisten, (struct sockaddr *) &addr, sizeof(addr)) == SOCKET_ERROR)
+    // The response of a pending client is still being generated, so bytes
+    // read meanwhile are only kept for when it is sent.
+    if (client->pending)
     {
-        sprintf(error_msg, "Failed to bind the listening socket on port %d.", m_port);
-#if defined(SPP_WINDOWS)
-        err = WSAGetLastError();
-#elif defined(SPP_LINUX)
-        // TODO
-#endif
-        closesocket(m_slisten);
-        throw TCPException(error_msg, err);
+        if (bytes > 0)
+            client->header_size += bytes;
+        else if (bytes == 0 || WSAGetLastError() != WSAEWOULDBLOCK)
+            client->eof = true;
+
+        return;
     }
 
-    // Start listening.
-    if (listen(m_slisten, SOMAXCONN) == SOCKET_ERROR)
+    // Lingering clients are closed during shutdown.
+    if (!is_running())
     {
-#if defined(SPP_WINDOWS)
-        err = WSAGetLastError();
-#elif defined(SPP_LINUX)
-        // TODO
-#endif
-        closesocket(m_slisten);
-        throw TCPException("Listen failed.", err);
+        close_client(worker, client);
+        return;
     }
 
-    // Start the worker thread.
-#if defined(SPP_WINDOWS)
-    m_listener = (HANDLE)_beginthreadex(NULL, 0, &tcp_listener, this, 0, NULL);
-#elif defined(SPP_LINUX)
-    // TODO
+    if (event->events & SPP_EVENT_RECV)
+        finish_read(worker, client, bytes);
+    else
+        finish_write(worker, client, bytes);
+}
+
 #endif
 
-    m_stop = false;
+/**
+ * TCPServer::serve
+ *
+ * @description Generates the response to the client's parsed request. This
+ * runs on the thread pool.
+ * @param[out] {client} // The client.
+ */
+void TCPServer::serve(TCPClient* client)
+{
+    TCPServerManager* manager;
+    char ip_buffer[INET_ADDRSTRLEN];
+    HTTPView method, uri;
+
+    manager = TCPServerManager::get_manager();
+    method = client->request.get_method();
+    uri = client->request.get_uri();
+
+    // Persist the connection unless the request limit is reached.
+    client->keep_alive = client->request.is_keep_alive() &&
+        client->requests + 1 < m_keepalive_requests;
+
+    manager->log(
+        TCPServerManager::INFO,
+        m_log.c_str(),
+        "%s:%d %.*s %.*s %d",
+        inet_ntop(AF_INET, &(client->addr.sin_addr), ip_buffer, INET_ADDRSTRLEN),
+        ntohs(client->addr.sin_port),
+        (int)method.size,
+        method.data,
+        (int)uri.size,
+        uri.data,
+        generate_response(client, &client->request) // Generate the response.
+    );
 }
 
 /**
- * TCPServer::is_running
+ * TCPServer::set_response
  *
- * @description Returns a flag indicating if the server is running.
- * @returns // True if it is running; false otherwise.
+ * @description Writes the status line and headers and queues the response.
+ * @param[out] {client} // The client.
+ * @param[in]  {code}   // The response status.
+ * @param[in]  {type}   // The content type.
+ * @param[in]  {body}   // The body (NULL if the client streams a file).
+ * @param[in]  {size}   // The content length.
+ * @param[in]  {fields} // Additional header fields, each ending in CRLF.
  */
-bool TCPServer::is_running(void)
+void TCPServer::set_response(TCPClient* client, status code, const char* type, const char* body, size_t size, const char* fields)
 {
-    bool status;
-
-    m_mtx_stop.aquire();
+    int length;
 
-    status = !m_stop;
+    // A 304 has no body, and its headers must not describe one.
+    if (code == NOT_MODIFIED)
+    {
+        length = snprintf(
+            client->response,
+            sizeof(client->response),
+            "HTTP/1.1 %d %s\r\n"
+            "Server: Server++\r\n"
+            "Connection: %s\r\n"
+            "%s\r\n",
+            code,
+            get_reason(code),
+            client->keep_alive ? "keep-alive" : "close",
+            fields
+        );
+    }
+    else
+    {
+        length = snprintf(
+            client->response,
+            sizeof(client->response),
+            "HTTP/1.1 %d %s\r\n"
+            "Server: Server++\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %lu\r\n"
+            "Connection: %s\r\n"
+            "%s\r\n",
+            code,
+            get_reason(code),
+            type,
+            (unsigned long)size,
+            client->keep_alive ? "keep-alive" : "close",
+            fields
+        );
+    }
 
-    m_mtx_stop.release();
+    // HEAD responses describe the body without sending it.
+    if (code == NOT_MODIFIED || client->request.get_method().equals("HEAD"))
+    {
+        client->file_remaining = 0;
+        body = NULL;
+        size = 0;
+    }
 
-    return status;
+    client->prepare((size_t)length, body, size);
 }
 
 /**
- * TCPServer::run
+ * TCPServer::set_ranges
  *
- * @description: Accepts incomming connections and serves content.
- * @returns // The termination status.
+ * @description Queues a 206 response with the requested ranges of the
+ * body, or a 416 response if none are satisfiable. Ranges are sent from
+ * the cached body or streamed from the file like a full body.
+ * @param[out] {client} // The client.
+ * @param[in]  {type}   // The content type.
+ * @param[in]  {size}   // The size of the body.
+ * @param[in]  {ranges} // The ranges.
+ * @param[in]  {count}  // The number of ranges (-1 if unsatisfiable).
+ * @param[in]  {fields} // Additional header fields, each ending in CRLF.
+ * @returns // The response status.
  */
-int TCPServer::run(void)
+status TCPServer::set_ranges(TCPClient* client, const char* type, size_t size, HTTPRange* ranges, int count, const char* fields)
 {
-    fd_set fd_read, fd_write, fd_except;
-    list<TCPClient>::iterator it;
-    TCPServerManager* manager;
-    list<TCPClient> clients;
-    socklen_t addrlen;
-    sockaddr_in addr;
-    SOCKET sclient;
-    DWORD timeout;
-    int err;
-    u_long mode;
-    SSL* ssl;
-
-    char ip_buffer[INET_ADDRSTRLEN];
-    int recv_bytes,
-        send_bytes,
-        errlen;
+    char range[96], boundary[24];
+    unsigned long long nonce;
+    string content_type;
+    size_t length;
+    TCPPart part;
+    int i;
 
-    manager = TCPServerManager::get_manager();
-    addrlen = sizeof(addr);
-    errlen = sizeof(err);
-    timeout = 1000;
-    mode = 1;
+    client->file_remaining = 0;
 
-    while (is_running())
+    // The representation's validators go with the size it could not cover.
+    if (count < 0)
     {
-        // Initialize the fd_sets.
-        FD_ZERO(&fd_read);
-        FD_ZERO(&fd_write);
-        FD_ZERO(&fd_except);
+        snprintf(range, sizeof(range), "Content-Range: bytes */%lu\r\n", (unsigned long)size);
+        set_response(client, RANGE_NOT_SATISFIABLE, "text/html", SPP_HTTP_416, strlen(SPP_HTTP_416), (string(fields) + range).c_str());
+        return RANGE_NOT_SATISFIABLE;
+    }
 
-        FD_SET(m_slisten, &fd_read);
-        FD_SET(m_slisten, &fd_except);
+    if (count == 1)
+    {
+        snprintf(
+            range,
+            sizeof(range),
+            "Content-Range: bytes %lu-%lu/%lu\r\n",
+            (unsigned long)ranges[0].offset,
+            (unsigned long)(ranges[0].offset + ranges[0].size - 1),
+            (unsigned long)size
+        );
 
-        for (it = clients.begin(); it != clients.end(); it++)
+        if (client->cached == NULL)
         {
-            // Space available for read buffer.
-            if (it->header_size < SPP_MAX_HEADER_SIZE)
-                FD_SET(it->socket, &fd_read);
+            client->file_offset = ranges[0].offset;
+            client->file_remaining = ranges[0].size;
+        }
 
-            // Data required to be sent.
-            if (it->header_size > 0 || it->content_size > 0)
-                FD_SET(it->socket, &fd_write);
+        set_response(
+            client,
+            PARTIAL_CONTENT,
+            type,
+            client->cached != NULL ? client->cached->get_data() + ranges[0].offset : NULL,
+            ranges[0].size,
+            (string(fields) + range).c_str()
+        );
 
-            FD_SET(it->socket, &fd_except);
-        }
+        return PARTIAL_CONTENT;
+    }
 
-        // Wait for socket activity.
-        if (select(0, &fd_read, &fd_write, &fd_except, 0) <= 0)
-        {
-            if (!is_running())
-                return 0;
+    // Each part is a delimiter and header block followed by its range. A
+    // random boundary keeps file contents from matching it.
+    if (RAND_bytes((unsigned char*)&nonce, sizeof(nonce)) != 1)
+        nonce = get_ticks() ^ (unsigned long long)(uintptr_t)client;
 
-            // Select failed.
-            return manager->log(
-                TCPServerManager::ERR,
-                m_log.c_str(),
-                "select() failed. {%d}",
-                WSAGetLastError()
-                );
-        }
+    snprintf(boundary, sizeof(boundary), "%016llx", nonce);
+    length = 0;
 
-        if (FD_ISSET(m_slisten, &fd_read))
-        {
-            // Accept a connection.
-            if ((sclient = accept(m_slisten, (sockaddr*)&addr, &addrlen)) == SOCKET_ERROR)
-            {
-                if (!is_running())
-                    return 0;
+    for (i = 0; i < count; i++)
+    {
+        snprintf(
+            range,
+            sizeof(range),
+            "Content-Range: bytes %lu-%lu/%lu\r\n\r\n",
+            (unsigned long)ranges[i].offset,
+            (unsigned long)(ranges[i].offset + ranges[i].size - 1),
+            (unsigned long)size
+        );
 
-                return manager->log(
-                    TCPServerManager::ERR,
-                    m_log.c_str(),
-                    "Failed to accept a connection. {%d}",
-                    WSAGetLastError()
-                    );
-            }
+        part.header = client->part_headers.size();
+        client->part_headers.append("\r\n--").append(boundary).append("\r\nContent-Type: ").append(type).append("\r\n").append(range);
+        part.header_size = client->part_headers.size() - part.header;
+        part.offset = ranges[i].offset;
+        part.size = ranges[i].size;
 
-            // Set the timeout.
-            setsockopt(sclient, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof timeout);
-            ssl = NULL;
+        client->parts.push_back(part);
+        length += part.header_size + part.size;
+    }
 
-            // Attempt the handshake if SSL is enabled.
-            if (m_ssl_ctx != NULL)
-            {
-                ssl = SSL_new(m_ssl_ctx);
-                SSL_set_fd(ssl, sclient);
-                err = SSL_accept(ssl);
+    // The closing delimiter is a part without a body.
+    part.header = client->part_headers.size();
+    client->part_headers.append("\r\n--").append(boundary).append("--\r\n");
+    part.header_size = client->part_headers.size() - part.header;
+    part.offset = 0;
+    part.size = 0;
 
-                if (err <= 0)
-                {
-                    SSL_shutdown(ssl);
-                    SSL_free(ssl);
-                    ssl = NULL;
-                }
-            }
+    client->parts.push_back(part);
+    length += part.header_size;
 
-            // Add to the list of clients.
-            ioctlsocket(sclient, FIONBIO, &mode);
-            clients.push_back(TCPClient(sclient, ssl));
+    content_type = string("multipart/byteranges; boundary=") + boundary;
+    set_response(client, PARTIAL_CONTENT, content_type.c_str(), NULL, length, fields);
+    return PARTIAL_CONTENT;
+}
 
-        }
-        else if (FD_ISSET(m_slisten, &fd_except))
-        {
-            getsockopt(m_slisten, SOL_SOCKET, SO_ERROR, (char*)&err, &errlen);
-            return manager->log(
-                TCPServerManager::ERR,
-                m_log.c_str(),
-                "Listening socket error. {%d}",
-                err
-                );
-        }
+/**
+ * TCPServer::generate_default
+ *
+ * @description Generates a built-in response without touching the disk.
+ * @param[out] {client} // The client.
+ * @param[in]  {code}   // The response status.
+ * @param[in]  {body}   // The constant content.
+ * @returns // The response status.
+ */
+status TCPServer::generate_default(TCPClient* client, status code, const char* body)
+{
+    set_response(client, code, "text/html", body, strlen(body));
+    return code;
+}
 
-        it = clients.begin();
-        while (it != clients.end())
-        {
-            // Check the fd_sets for activity.
-            if (FD_ISSET(it->socket, &fd_except))
-            {
-                FD_CLR(it->socket, &fd_except);
-                goto close_connection;
-            }
-            else
-            {
-                if (FD_ISSET(it->socket, &fd_read))
-                {
-                    // Recv bytes.
-                    recv_bytes = it->recv();
-
-                    // Client closed the connection.
-                    if (recv_bytes == 0)
-                        goto close_connection;
-
-                    if (recv_bytes == SOCKET_ERROR)
-                    {
-                        getsockopt(it->socket, SOL_SOCKET, SO_ERROR, (char*)&err, &errlen);
-                        if (err != WSAEWOULDBLOCK) goto close_connection;
-                    }
-                    else
-                    {
-                        // Increment the recieved bytes and continue.
-                        it->header_size += recv_bytes;
-                        FD_CLR(it->socket, &fd_read);
-                    }
-                }
-                else if (FD_ISSET(it->socket, &fd_write))
-                {
-                    // If the connection failed the handshake, don't send a response.
-                    if (it->ssl == NULL && m_ssl_ctx != NULL)
-                    {
-                        FD_CLR(it->socket, &fd_write);
-                        goto close_connection;
-                    }
-
-                    // Generate the content if there is none.
-                    if (it->content == NULL)
-                    {
-                        HTTPRequest request(it->headers, it->header_size);
-                        manager->log(
-                            TCPServerManager::INFO,
-                            m_log.c_str(),
-                            "%s:%d %s %s %d",
-                            #if defined(_MSC_VER)
-                                inet_ntop(AF_INET, &(addr.sin_addr), ip_buffer, INET_ADDRSTRLEN)
-                            #else
-                                inet_ntoa(addr.sin_addr)
-                            #endif
-                            ,
-                            ntohs(addr.sin_port),
-                            request.get_method().c_str(),
-                            request.get_uri().c_str(),
-                            generate_response(&(*it), &request) // Generate the response.
-                        );
-                    }
+/**
+ * TCPServer::generate_error
+ *
+ * @description Generates an error response from the configured error pages.
+ * @param[out] {client}   // The client.
+ * @param[in]  {code}     // The response status.
+ * @param[in]  {fallback} // The default content if no page is configured.
+ * @returns // The response status.
+ */
+status TCPServer::generate_error(TCPClient* client, status code, const char* fallback)
+{
+    char key[8];
+    size_t size;
+    char* file;
 
-                    // Send bytes.
-                    send_bytes = it->send();
+    sprintf(key, "%d", code);
 
-                    if (send_bytes == SOCKET_ERROR)
-                    {
-                        getsockopt(it->socket, SOL_SOCKET, SO_ERROR, (char*)&err, &errlen);
-                        if (err != WSAEWOULDBLOCK) goto close_connection;
-                    }
+    if ((file = m_uri_map.get_error(key, &size)) == NULL)
+    {
+        // Use the default text.
+        set_response(client, code, "text/html", fallback, strlen(fallback));
+        return code;
+    }
 
-                    if (it->header_size == 0 && it->content_size == 0)
-                    {
-                        // Send complete.
-                        FD_CLR(it->socket, &fd_write);
-                        goto close_connection;
-                    }
+    client->content = file;
+    set_response(client, code, "text/html", file, size);
+    return code;
+}
 
-                }
-            }
+/**
+ * TCPServer::get_file
+ *
+ * @description Opens a file through the open file cache.
+ * @param[in] {path} // The resolved path.
+ * @returns // A reference to the file (NULL if it cannot be opened).
+ */
+FileHandle* TCPServer::get_file(const string& path)
+{
+    return m_files != NULL ? m_files->open(path) : FileHandle::open(path.c_str());
+}
 
-            it++;
-            continue;
+/**
+ * TCPServer::get_variant
+ *
+ * @description Opens a sidecar of a file. Sidecars older than the file
+ * are ignored, since they were not built from its current contents.
+ * @param[in] {path}   // The resolved path of the file.
+ * @param[in] {file}   // The file.
+ * @param[in] {suffix} // The sidecar suffix.
+ * @returns // A reference to the sidecar (NULL if there is none).
+ */
+FileHandle* TCPServer::get_variant(const string& path, FileHandle* file, const char* suffix)
+{
+    FileHandle* variant;
 
-        // Close a connection.
-        close_connection:
-            it->close();
-            clients.erase(it);
-            it = clients.begin();
-        }
-    }
+    if ((variant = get_file(path + suffix)) == NULL)
+        return NULL;
 
-    // Close lingering clients.
-    for (it = clients.begin(); it != clients.end(); it++)
-        it->close();
+    if (variant->get_info().mtime < file->get_info().mtime)
+    {
+        variant->release();
+        return NULL;
+    }
 
-    return 0;
+    return variant;
 }
 
 /**
  * TCPServer::generate_response
  *
- * @description Starts the listening socket and dispatches the worker thread.
+ * @description Generates the response for a request.
+ * @param[out] {client}  // The client.
+ * @param[out] {request} // The parsed request.
+ * @returns // The response status.
  */
 status TCPServer::generate_response(TCPClient* client, HTTPRequest* request)
 {
-    map<string, string> m_params;
     TCPServerManager* manager;
     HTTPLocation *location;
-    string path, response;
-    size_t size;
-    char *file;
+    char fields[256], etag[64], modified[32];
+    HTTPRange ranges[SPP_HTTP_MAX_RANGES];
+    FileHandle* variant;
+    const char* encoding;
+    string path, key, type;
+    bool vary, compress;
+    int accepted, count;
+    size_t i, size;
 
     // Get the location from the request.
     location = m_uri_map.get_location(request);
     manager = TCPServerManager::get_manager();
 
+    // Generate a 404 response.
     if (location == NULL)
-    {
-        // Generate a 404 response.
-        file = m_uri_map.get_error("404", &size);
-
-        if (file == NULL)
-        {
-            // Use the default 404 text.
-            size = strlen(SPP_HTTP_404);
-            file = new char[size];
-            strcpy(file, SPP_HTTP_404);
-        }
-
-        client->header_size = sprintf(
-            client->headers,
-            "HTTP/1.1 404 Not Found\n \
-            Server: Server++\n        \
-            Content-Type: text/html\n \
-            Content-Length: %d\n\r\n",
-            size
-        );
-
-        client->content_size = size;
-        client->content = file;
-        return NOT_FOUND;
-    }
+        return generate_error(client, NOT_FOUND, SPP_HTTP_404);
 
     if (location->is_proxied())
     {
         // TODO
     }
 
-    if (request->get_method() != "GET")
+    if (!request->get_method().equals("GET") && !request->get_method().equals("HEAD"))
     {
         // TODO
     }
 
-    // Serve the static file.
+    // Serve the static file. Equivalent spellings of a path share its keys.
     path = location->get_path(request);
-    file = read_file(path.c_str(), &size);
+    normalize_path(path);
+    key = path;
+
+    // Generate a 500 response.
+    if ((client->source = get_file(path)) == NULL)
+        return generate_error(client, INTERNAL_SERVER_ERROR, SPP_HTTP_500);
+
+    // Swap in a precompressed sidecar the client accepts. Lookups go
+    // through the open file cache, so missing sidecars are cached too.
+    accepted = request->get_encodings();
+    encoding = NULL;
+    vary = false;
 
-    if (file == NULL)
+    for (i = 0; i < sizeof(tcp_sidecars) / sizeof(tcp_sidecars[0]) && encoding == NULL; i++)
     {
-        // Generate a 500 response.
-        file = m_uri_map.get_error("500", &size);
+        if ((variant = get_variant(path, client->source, tcp_sidecars[i].suffix)) == NULL)
+            continue;
+
+        // The representation depends on Accept-Encoding once a sidecar exists.
+        vary = true;
 
-        if (file == NULL)
+        if (accepted & tcp_sidecars[i].flag)
+        {
+            client->source->release();
+            client->source = variant;
+            encoding = tcp_sidecars[i].name;
+            key = path + tcp_sidecars[i].suffix;
+        }
+        else
         {
-            // Use the default 500 text.
-            size = strlen(SPP_HTTP_500);
-            file = new char[size];
-            strcpy(file, SPP_HTTP_500);
+            variant->release();
         }
+    }
 
-        client->header_size = sprintf(
-            client->headers,
-            "HTTP/1.1 500 Internal Server Error\n \
-            Server: Server++\n                    \
-            Content-Type: text/html\n             \
-            Content-Length: %d\n\r\n",
-            size
-        );
+    type = manager->get_type(get_ext(path.c_str(), path.size()));
+    compress = false;
+
+    // Otherwise gzip compressible files that fit in the cache.
+    if (encoding == NULL && m_gzip_level > 0 && m_cache != NULL && m_gzip_types.count(type) != 0 &&
+        client->source->get_size() >= m_gzip_min_size && client->source->get_size() <= m_cache->get_max_file())
+    {
+        vary = true;
+        compress = (accepted & SPP_ENCODING_GZIP) != 0;
+    }
+
+    // Each version of a file is compressed once, here on the pool, and then
+    // served from memory. The coding is settled before the validators,
+    // since the tag names it.
+    if (compress)
+    {
+        if ((client->cached = m_cache->get(path, client->source, SPP_ENCODING_GZIP)) == NULL)
+            client->cached = m_cache->compress(path, client->source, m_gzip_level);
+
+        // An empty body records that compression did not pay off.
+        if (client->cached != NULL && client->cached->get_size() == 0)
+        {
+            client->cached->release();
+            client->cached = NULL;
+        }
 
-        client->content = file;
-        client->content_size = size;
-        return INTERNAL_SERVER_ERROR;
+        if ((compress = client->cached != NULL))
+            encoding = "gzip";
     }
 
-    // Generate a 200 response.
-    client->header_size = sprintf(
-        client->headers,
-        "HTTP/1.1 200 OK\n  \
-         Server: Server++\n \
-         Content-Type: %s\n \
-         Content-Length: %d\n\r\n",
-        manager->get_type(get_ext(path.c_str(), path.size())).c_str(),
-        size
+    // Validators come from the file that is sent. Compressed bodies get
+    // their own tag, since their bytes differ from the file's.
+    snprintf(
+        etag,
+        sizeof(etag),
+        "\"%llx-%llx-%llx%s\"",
+        client->source->get_info().inode,
+        (unsigned long long)client->source->get_size(),
+        (unsigned long long)client->source->get_info().mtime,
+        compress ? "-gzip" : ""
+    );
+
+    format_http_date(client->source->get_info().mtime, modified, sizeof(modified));
+
+    // Answer revalidations without sending the body.
+    if (request->is_not_modified(etag, client->source->get_info().mtime))
+    {
+        snprintf(fields, sizeof(fields), "ETag: %s\r\nLast-Modified: %s\r\n%s", etag, modified, vary ? "Vary: Accept-Encoding\r\n" : "");
+        set_response(client, NOT_MODIFIED, type.c_str(), NULL, 0, fields);
+        return NOT_MODIFIED;
+    }
+
+    snprintf(
+        fields,
+        sizeof(fields),
+        "%s%s%s%s%s"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n",
+        encoding != NULL ? "Content-Encoding: " : "",
+        encoding != NULL ? encoding : "",
+        encoding != NULL ? "\r\n" : "",
+        vary ? "Vary: Accept-Encoding\r\n" : "",
+        encoding == NULL ? "Accept-Ranges: bytes\r\n" : "",
+        etag,
+        modified
+    );
+
+    // Hot and small files are sent from memory. Larger ones are streamed
+    // after the header.
+    if (client->cached == NULL && m_cache != NULL && (client->cached = m_cache->get(key, client->source)) == NULL)
+        client->cached = m_cache->load(key, client->source);
+
+    size = client->cached != NULL ? client->cached->get_size() : client->source->get_size();
+
+    if (client->cached == NULL)
+    {
+        client->file = client->source->get_fd();
+        client->file_offset = 0;
+        client->file_remaining = size;
+    }
+
+    // Serve byte ranges of files sent as is, unless the client's copy is
+    // out of date.
+    if (encoding == NULL && request->get_method().equals("GET") &&
+        (count = request->get_ranges(size, ranges, SPP_HTTP_MAX_RANGES)) != 0 &&
+        request->is_range_current(etag, client->source->get_info().mtime))
+    {
+        return set_ranges(client, type.c_str(), size, ranges, count, fields);
+    }
+
+    set_response(
+        client,
+        OK,
+        type.c_str(),
+        client->cached != NULL ? client->cached->get_data() : NULL,
+        size,
+        fields
     );
 
-    client->content = file;
-    client->content_size = size;
     return OK;
 }
 
@@ -661,8 +2845,23 @@ status TCPServer::generate_response(TCPClient* client, HTTPRequest* request)
  */
 void TCPServer::wait(void)
 {
+    unsigned int i;
+
+    for (i = 0; i < m_workers.size(); i++)
+    {
 #if defined(SPP_WINDOWS)
-    WaitForSingleObject(m_listener, INFINITE);
+        WaitForSingleObject(m_workers[i]->thread, INFINITE);
+#elif defined(SPP_LINUX)
+        pthread_join(m_workers[i]->thread, NULL);
+#endif
+    }
+
+    // The workers have drained their pending responses.
+    m_pool->stop();
+
+#if defined(SPP_LINUX)
+    if (m_watcher != NULL)
+        m_watcher->stop();
 #endif
 }
 
@@ -673,13 +2872,13 @@ void TCPServer::wait(void)
  */
 void TCPServer::stop(void)
 {
-    m_mtx_stop.aquire();
+    unsigned int i;
 
-    // Set the flag and close the listening socket.
-    m_stop = true;
-    closesocket(m_slisten);
+    // Set the flag and wake the workers, which close their own listeners.
+    m_stop.store(true, std::memory_order_release);
 
-    m_mtx_stop.release();
+    for (i = 0; i < m_workers.size(); i++)
+        m_workers[i]->notifier.signal();
 }
 
 /**
@@ -747,7 +2946,13 @@ void TCPServerManager::add_type(string ext, string mime)
  *
  * @description Returns a type from the provided extension.
  */
-string TCPServerManager::get_type(string ext)
+string TCPServerManager::get_type(string ext) const
 {
-    return m_mimes[ext];
+    map<string, string>::const_iterator it;
+
+    // Workers share the table, so lookups must not insert.
+    if ((it = m_mimes.find(ext)) == m_mimes.end())
+        return string();
+
+    return it->second;
 }
\ No newline at end of file
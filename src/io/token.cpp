@@ -0,0 +1,231 @@
+/**
+ * Serverpp token implementation
+ *
+ * Author: Mayank Sindwani
+ * Date: 2015-10-10
+ */
+
+#include <spp/token.h>
+
+// Vector paths are compiled per function and selected at runtime, so the
+// library still runs on processors without them.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SPP_TOKEN_SIMD
+    #include <immintrin.h>
+#endif
+
+using namespace spp;
+
+typedef size_t (*token_scanner)(const char*, size_t, int);
+
+/**
+ * get_delimiters
+ *
+ * @description Expands delimiter classes into the bytes they match.
+ * @param[in]  {classes} // The delimiter classes.
+ * @param[out] {set}     // The delimiter bytes (at least 8).
+ * @returns // The number of delimiter bytes.
+ */
+static int get_delimiters(int classes, char* set)
+{
+    int count = 0;
+
+    if (classes & SPP_TOKEN_SP)      set[count++] = ' ';
+    if (classes & SPP_TOKEN_CRLF)    set[count++] = '\r',
+                                     set[count++] = '\n';
+    if (classes & SPP_TOKEN_COLON)   set[count++] = ':';
+    if (classes & SPP_TOKEN_QUERY)   set[count++] = '?';
+    if (classes & SPP_TOKEN_AMP)     set[count++] = '&';
+    if (classes & SPP_TOKEN_EQUALS)  set[count++] = '=';
+    if (classes & SPP_TOKEN_PERCENT) set[count++] = '%';
+
+    return count;
+}
+
+/**
+ * TokenTable: Maps every byte to the delimiter classes it belongs to.
+ */
+static struct TokenTable
+{
+    unsigned char classes[256];
+
+    TokenTable(void)
+    {
+        char set[8];
+        int bit, i, count;
+
+        for (i = 0; i < 256; i++)
+            classes[i] = 0;
+
+        for (bit = SPP_TOKEN_SP; bit <= SPP_TOKEN_PERCENT; bit <<= 1)
+        {
+            count = get_delimiters(bit, set);
+
+            for (i = 0; i < count; i++)
+                classes[(unsigned char)set[i]] |= bit;
+        }
+    }
+} s_table;
+
+/**
+ * find_token_scalar
+ *
+ * @description Scans a buffer one byte at a time.
+ * @param[in] {data}    // The buffer.
+ * @param[in] {size}    // The buffer size.
+ * @param[in] {classes} // The delimiter classes.
+ * @returns // The offset of the first delimiter (size if none).
+ */
+static size_t find_token_scalar(const char* data, size_t size, int classes)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (s_table.classes[(unsigned char)data[i]] & classes)
+            return i;
+    }
+
+    return size;
+}
+
+#if defined(SPP_TOKEN_SIMD)
+
+/**
+ * find_token_sse42
+ *
+ * @description Scans a buffer 16 bytes at a time with a string compare
+ * against the delimiter set.
+ * @param[in] {data}    // The buffer.
+ * @param[in] {size}    // The buffer size.
+ * @param[in] {classes} // The delimiter classes.
+ * @returns // The offset of the first delimiter (size if none).
+ */
+__attribute__((target("sse4.2")))
+static size_t find_token_sse42(const char* data, size_t size, int classes)
+{
+    char set[16] = { 0 };
+    __m128i needle, chunk;
+    size_t i;
+    int count, index;
+
+    count = get_delimiters(classes, set);
+    needle = _mm_loadu_si128((const __m128i*)set);
+
+    for (i = 0; i + 16 <= size; i += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        index = _mm_cmpestri(
+            needle, count, chunk, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT
+        );
+
+        if (index < 16)
+            return i + index;
+    }
+
+    return i + find_token_scalar(data + i, size - i, classes);
+}
+
+/**
+ * find_token_avx2
+ *
+ * @description Scans a buffer 32 bytes at a time by comparing it against
+ * each delimiter byte.
+ * @param[in] {data}    // The buffer.
+ * @param[in] {size}    // The buffer size.
+ * @param[in] {classes} // The delimiter classes.
+ * @returns // The offset of the first delimiter (size if none).
+ */
+__attribute__((target("avx2")))
+static size_t find_token_avx2(const char* data, size_t size, int classes)
+{
+    __m256i needles[8], chunk, matches;
+    unsigned int mask;
+    char set[8];
+    int count, j;
+    size_t i;
+
+    count = get_delimiters(classes, set);
+
+    for (j = 0; j < count; j++)
+        needles[j] = _mm256_set1_epi8(set[j]);
+
+    for (i = 0; i + 32 <= size; i += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        matches = _mm256_setzero_si256();
+
+        for (j = 0; j < count; j++)
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chunk, needles[j]));
+
+        if ((mask = (unsigned int)_mm256_movemask_epi8(matches)) != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + find_token_scalar(data + i, size - i, classes);
+}
+
+#endif
+
+/**
+ * select_scanner
+ *
+ * @description Picks the widest scanner the processor supports.
+ * @param[out] {name} // The scanner name.
+ * @returns // The scanner.
+ */
+static token_scanner select_scanner(const char** name)
+{
+#if defined(SPP_TOKEN_SIMD)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return find_token_avx2;
+    }
+
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        *name = "sse4.2";
+        return find_token_sse42;
+    }
+#endif
+
+    *name = "scalar";
+    return find_token_scalar;
+}
+
+static const char* s_name;
+static token_scanner s_scanner = select_scanner(&s_name);
+
+/**
+ * find_token
+ *
+ * @description Finds the first byte that belongs to any of the delimiter
+ * classes.
+ * @param[in] {data}    // The buffer.
+ * @param[in] {size}    // The buffer size.
+ * @param[in] {classes} // The delimiter classes.
+ * @returns // The offset of the first delimiter (size if none).
+ */
+size_t spp::find_token(const char* data, size_t size, int classes)
+{
+    // Short fields are not worth a vector setup.
+    if (size < 16)
+        return find_token_scalar(data, size, classes);
+
+    return s_scanner(data, size, classes);
+}
+
+/**
+ * get_tokenizer
+ *
+ * @description Returns the name of the scanner in use.
+ * @returns // The scanner name.
+ */
+const char* spp::get_tokenizer(void)
+{
+    return s_name;
+}
\ No newline at end of file
@@ -5,7 +5,20 @@
  * Date: 2015-09-18
  */
 
-#include <spp\util.h>
+#include <spp/util.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(SPP_WINDOWS)
+#include <Windows.h>
+#include <io.h>
+#elif defined(SPP_LINUX)
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -28,32 +41,6 @@ void spp::render_template(string& src, map<string, string>* params)
     }
 }
 
-/**
- * trim
- *
- * @description Skips to the next word in a string.
- * @param[in]  {buffer} // The string to trim.
- * @param[out] {size}   // The buffer size.
- */
-int spp::trim(char** buffer, size_t size, int* pos)
-{
-    unsigned int cpos, length;
-
-    cpos = 0;
-    (*buffer) += *pos;
-
-    // Skip to the next whitespace character.
-    while (cpos < size && !isspace((*buffer)[cpos])) cpos++;
-
-    length = cpos;
-
-    // Ignore subsequent whitespace characters.
-    while (cpos < size &&  isspace((*buffer)[cpos])) cpos++;
-
-    *pos = cpos;
-    return length;
-}
-
 /**
  * read_file
  *
@@ -86,6 +73,94 @@ char* spp::read_file(const char* path, size_t* size)
     return buffer;
 }
 
+/**
+ * open_file
+ *
+ * @description Opens a regular file for reading.
+ * @param[out] {path} // The file path.
+ * @param[out] {info} // The file metadata.
+ * @returns // The file descriptor (-1 on failure).
+ */
+int spp::open_file(const char* path, FileInfo* info)
+{
+    int fd;
+
+#if defined(SPP_WINDOWS)
+    struct _stat64 st;
+
+    if ((fd = _open(path, _O_RDONLY | _O_BINARY)) < 0)
+        return -1;
+
+    if (_fstat64(fd, &st) < 0 || !(st.st_mode & _S_IFREG))
+    {
+        _close(fd);
+        return -1;
+    }
+#else
+    struct stat st;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+#endif
+
+    info->size = (size_t)st.st_size;
+    info->mtime = (long long)st.st_mtime;
+    info->inode = (unsigned long long)st.st_ino;
+    return fd;
+}
+
+/**
+ * read_file_at
+ *
+ * @description Reads part of a file opened with open_file without moving
+ * a shared offset.
+ * @param[in]  {fd}     // The file descriptor.
+ * @param[out] {buffer} // The destination buffer.
+ * @param[in]  {size}   // The number of bytes to read.
+ * @param[in]  {offset} // The file offset.
+ * @returns // The number of bytes read (-1 on failure).
+ */
+long spp::read_file_at(int fd, char* buffer, size_t size, long long offset)
+{
+#if defined(SPP_WINDOWS)
+    OVERLAPPED overlapped;
+    DWORD read_bytes;
+
+    // Read at an explicit offset so threads can share the descriptor.
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+    if (!ReadFile((HANDLE)_get_osfhandle(fd), buffer, (DWORD)size, &read_bytes, &overlapped))
+        return -1;
+
+    return (long)read_bytes;
+#else
+    return (long)pread(fd, buffer, size, (off_t)offset);
+#endif
+}
+
+/**
+ * close_file
+ *
+ * @description Closes a file opened with open_file.
+ * @param[in] {fd} // The file descriptor.
+ */
+void spp::close_file(int fd)
+{
+#if defined(SPP_WINDOWS)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
 /**
  * get_ext
  *
@@ -113,4 +188,115 @@ char* spp::get_ext(const char* path, size_t size)
     }
 
     return NULL;
+}
+
+/**
+ * normalize_path
+ *
+ * @description Collapses repeated separators and "./" segments, which
+ * name the same file, so that each file has one spelling.
+ * @param[out] {path} // The file path.
+ */
+void spp::normalize_path(string& path)
+{
+    size_t i, j;
+
+    for (i = 0, j = 0; i < path.size(); i++)
+    {
+        if (path[i] == '/' && j > 0 && path[j - 1] == '/')
+            continue;
+
+        // Skip the segment and its separator.
+        if (path[i] == '.' && j > 0 && path[j - 1] == '/' && i + 1 < path.size() && path[i + 1] == '/')
+        {
+            i++;
+            continue;
+        }
+
+        path[j++] = path[i];
+    }
+
+    path.resize(j);
+}
+
+// HTTP date names.
+static const char* util_days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char* util_months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+/**
+ * format_http_date
+ *
+ * @description Formats a time as an IMF-fixdate.
+ * @param[in]  {time}   // The time in seconds since the epoch.
+ * @param[out] {buffer} // The output buffer.
+ * @param[in]  {size}   // The size of the output buffer.
+ */
+void spp::format_http_date(long long time, char* buffer, size_t size)
+{
+    time_t t;
+    tm gmt;
+
+    t = (time_t)time;
+
+#if defined(SPP_WINDOWS)
+    gmtime_s(&gmt, &t);
+#else
+    gmtime_r(&t, &gmt);
+#endif
+
+    snprintf(
+        buffer,
+        size,
+        "%s, %02d %s %04d %02d:%02d:%02d GMT",
+        util_days[gmt.tm_wday],
+        gmt.tm_mday,
+        util_months[gmt.tm_mon],
+        gmt.tm_year + 1900,
+        gmt.tm_hour,
+        gmt.tm_min,
+        gmt.tm_sec
+    );
+}
+
+/**
+ * parse_http_date
+ *
+ * @description Parses an IMF-fixdate. The obsolete date formats are not
+ * accepted.
+ * @param[in]  {date} // The date.
+ * @param[in]  {size} // The size of the date.
+ * @param[out] {time} // The time in seconds since the epoch.
+ * @returns // True if the date is valid; false otherwise.
+ */
+bool spp::parse_http_date(const char* date, size_t size, long long* time)
+{
+    char buffer[32], day[4], month[4];
+    int i;
+    tm gmt;
+
+    if (size >= sizeof(buffer))
+        return false;
+
+    memcpy(buffer, date, size);
+    buffer[size] = '\0';
+    memset(&gmt, 0, sizeof(gmt));
+
+    if (sscanf(buffer, "%3s, %2d %3s %4d %2d:%2d:%2d GMT", day, &gmt.tm_mday, month, &gmt.tm_year, &gmt.tm_hour, &gmt.tm_min, &gmt.tm_sec) != 7)
+        return false;
+
+    for (i = 0; i < 12 && strcmp(month, util_months[i]) != 0; i++);
+
+    if (i == 12)
+        return false;
+
+    gmt.tm_mon = i;
+    gmt.tm_year -= 1900;
+
+#if defined(SPP_WINDOWS)
+    *time = (long long)_mkgmtime(&gmt);
+#else
+    *time = (long long)timegm(&gmt);
+#endif
+
+    return *time >= 0;
 }
\ No newline at end of file
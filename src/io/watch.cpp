@@ -0,0 +1,309 @@
+/**
+ * Serverpp watch implementation
+ *
+ * Author: Mayank Sindwani
+ * Date: 2015-10-13
+ */
+
+#include <spp/watch.h>
+
+#if defined(SPP_LINUX)
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <dirent.h>
+#include <poll.h>
+
+// Events that change what a path resolves to.
+#define SPP_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | \
+                        IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+using namespace spp;
+using namespace std;
+
+/**
+ * FileWatcher Constructor
+ *
+ * @description Creates a watcher without any watched directories.
+ * @param[in] {files} // The open file cache (may be NULL).
+ * @param[in] {cache} // The content cache (may be NULL).
+ */
+FileWatcher::FileWatcher(FileCache* files, ContentCache* cache)
+    : m_first(0),
+      m_last(0),
+      m_files(files),
+      m_cache(cache),
+      m_running(false),
+      m_reset(false)
+{
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+/**
+ * FileWatcher Destructor
+ *
+ * @description Stops the watcher and releases its watches.
+ */
+FileWatcher::~FileWatcher(void)
+{
+    stop();
+
+    if (m_inotify >= 0)
+        close(m_inotify);
+}
+
+/**
+ * FileWatcher::add_tree
+ *
+ * @description Watches a directory and the directories below it.
+ * @param[in] {path} // The directory path.
+ * @returns // True if the directory itself is watched.
+ */
+bool FileWatcher::add_tree(const string& path)
+{
+    struct dirent* entry;
+    struct stat st;
+    string child;
+    DIR* dir;
+    int wd;
+
+    if ((wd = inotify_add_watch(m_inotify, path.c_str(), SPP_WATCH_MASK)) < 0)
+        return false;
+
+    m_dirs[wd] = path;
+
+    if ((dir = opendir(path.c_str())) == NULL)
+        return true;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        child = path + "/" + entry->d_name;
+
+        // Some filesystems do not report the entry type.
+        if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode)))
+            add_tree(child);
+    }
+
+    closedir(dir);
+    return true;
+}
+
+/**
+ * FileWatcher::watch
+ *
+ * @description Watches a server root. Paths are joined and normalized
+ * like the server's request paths, so they match the keys of the caches.
+ * @param[in] {root} // The root directory.
+ * @returns // True if the root is watched.
+ */
+bool FileWatcher::watch(const string& root)
+{
+    if (!is_open())
+        return false;
+
+    m_root = root;
+    normalize_path(m_root);
+
+    if (m_root.size() > 1 && m_root[m_root.size() - 1] == '/')
+        m_root.erase(m_root.size() - 1);
+
+    return add_tree(m_root);
+}
+
+/**
+ * FileWatcher::read_events
+ *
+ * @description Drains the inotify queue into the pending changes.
+ */
+void FileWatcher::read_events(void)
+{
+    char buffer[SPP_WATCH_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    unordered_map<int, string>::iterator it;
+    struct inotify_event* event;
+    ssize_t read_bytes;
+    string path;
+    char* offset;
+
+    while ((read_bytes = read(m_inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (offset = buffer; offset < buffer + read_bytes; offset += sizeof(struct inotify_event) + event->len)
+        {
+            event = (struct inotify_event*)offset;
+
+            if (m_first == 0)
+                m_first = get_ticks();
+
+            m_last = get_ticks();
+
+            // Events were dropped; nothing can be trusted.
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                m_reset = true;
+                continue;
+            }
+
+            if ((it = m_dirs.find(event->wd)) == m_dirs.end())
+                continue;
+
+            if (event->mask & IN_IGNORED)
+            {
+                m_dirs.erase(it);
+                m_reset = true;
+                continue;
+            }
+
+            // A watched directory left the tree, taking its files with it.
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                inotify_rm_watch(m_inotify, event->wd);
+                m_reset = true;
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            path = it->second + "/" + event->name;
+
+            // Directory changes affect every path below them.
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    add_tree(path);
+
+                m_reset = true;
+            }
+            else if (!m_reset)
+            {
+                m_changed.insert(path);
+
+                if (m_changed.size() > SPP_WATCH_MAX_PATHS)
+                    m_reset = true;
+            }
+        }
+    }
+}
+
+/**
+ * FileWatcher::flush
+ *
+ * @description Invalidates the pending changes.
+ */
+void FileWatcher::flush(void)
+{
+    unordered_set<string>::iterator it;
+
+    if (m_reset)
+    {
+        if (m_files != NULL) m_files->clear();
+        if (m_cache != NULL) m_cache->clear();
+
+        // Pick up directories that may have been missed.
+        add_tree(m_root);
+    }
+    else
+    {
+        for (it = m_changed.begin(); it != m_changed.end(); it++)
+        {
+            if (m_files != NULL) m_files->invalidate(*it);
+            if (m_cache != NULL) m_cache->invalidate(*it);
+        }
+    }
+
+    m_changed.clear();
+    m_reset = false;
+    m_first = 0;
+}
+
+/**
+ * FileWatcher::run
+ *
+ * @description Waits for changes and flushes them once the tree is quiet
+ * or the oldest change has waited long enough.
+ */
+void FileWatcher::run(void)
+{
+    unsigned long long now, deadline;
+    struct pollfd fds[2];
+    int timeout;
+
+    fds[0].fd = m_inotify;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_notifier.get_socket();
+    fds[1].events = POLLIN;
+
+    for (;;)
+    {
+        timeout = -1;
+
+        if (m_first != 0)
+        {
+            now = get_ticks();
+            deadline = m_last + SPP_WATCH_DELAY < m_first + SPP_WATCH_MAX_DELAY ? m_last + SPP_WATCH_DELAY : m_first + SPP_WATCH_MAX_DELAY;
+
+            if (deadline <= now)
+            {
+                flush();
+                continue;
+            }
+
+            timeout = (int)(deadline - now);
+        }
+
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+            break;
+
+        // The watcher is stopping.
+        if (fds[1].revents & POLLIN)
+            break;
+
+        if (fds[0].revents & POLLIN)
+            read_events();
+    }
+}
+
+/**
+ * FileWatcher::thread_main
+ *
+ * @description Thread callback to run the watcher.
+ * @param {param} // The watcher instance.
+ */
+void* FileWatcher::thread_main(void* param)
+{
+    ((FileWatcher*)param)->run();
+    return NULL;
+}
+
+/**
+ * FileWatcher::start
+ *
+ * @description Starts the watcher thread.
+ */
+void FileWatcher::start(void)
+{
+    if (m_running || !is_open())
+        return;
+
+    m_running = pthread_create(&m_thread, NULL, &thread_main, this) == 0;
+}
+
+/**
+ * FileWatcher::stop
+ *
+ * @description Stops and joins the watcher thread.
+ */
+void FileWatcher::stop(void)
+{
+    if (!m_running)
+        return;
+
+    m_notifier.signal();
+    pthread_join(m_thread, NULL);
+    m_notifier.clear();
+    m_running = false;
+}
+
+#endif
\ No newline at end of file